@@ -0,0 +1,127 @@
+// Compares the batched circle vs box kernel with the single box test the game used before it.
+// Build with `make bench`, `make bench SIMD_FLAGS=-mavx2` selects the eight lane kernel.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "collision.h"
+#include "mathc.h"
+
+#define BENCH_COLUMNS 15
+#define BENCH_ROWS 8
+#define BENCH_BOXES (BENCH_COLUMNS * BENCH_ROWS)
+#define BENCH_QUERIES 4096
+#define BENCH_ROUNDS 200
+#define BENCH_RADIUS 12.5f
+
+typedef struct {
+    mfloat_t center[VEC2_SIZE];
+    size_t first, count;
+} Query;
+
+static double now() {
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static float randomRange(float min, float max) {
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+int main() {
+    srand(1);
+    // a level the size of the game's, one brick per tile
+    mfloat_t positions[BENCH_BOXES][VEC2_SIZE];
+    mfloat_t sizes[BENCH_BOXES][VEC2_SIZE];
+    BoxBatch boxes;
+    InitBoxBatch(&boxes);
+    for (size_t i = 0; i < BENCH_BOXES; ++i) {
+        sizes[i][0] = 800.0f / BENCH_COLUMNS;
+        sizes[i][1] = 300.0f / BENCH_ROWS;
+        positions[i][0] = sizes[i][0] * (i % BENCH_COLUMNS);
+        positions[i][1] = sizes[i][1] * (i / BENCH_COLUMNS);
+        PushBox(&boxes, positions[i], sizes[i]);
+    }
+
+    // balls anywhere over the level, each against a run of boxes like the broadphase hands out
+    Query* queries = malloc(BENCH_QUERIES * sizeof(Query));
+    for (size_t i = 0; i < BENCH_QUERIES; ++i) {
+        queries[i].center[0] = randomRange(-20.0f, 820.0f);
+        queries[i].center[1] = randomRange(-20.0f, 320.0f);
+        queries[i].count = 1 + rand() % COLLISION_BATCH;
+        queries[i].first = rand() % (BENCH_BOXES - queries[i].count + 1);
+    }
+
+    // decisions first: the kernels must agree bit for bit, the sqrt test only up to rounding
+    Collision simd[COLLISION_BATCH], scalar[COLLISION_BATCH];
+    size_t mismatches = 0, sqrtDisagreements = 0, hits = 0;
+    for (size_t i = 0; i < BENCH_QUERIES; ++i) {
+        const Query* query = &queries[i];
+        uint32_t mask = CollideCircleBoxes(query->center, BENCH_RADIUS, &boxes, query->first, query->count, simd);
+        uint32_t scalarMask = CollideCircleBoxesScalar(query->center, BENCH_RADIUS, &boxes, query->first, query->count, scalar);
+        if (mask != scalarMask)
+            ++mismatches;
+        for (size_t lane = 0; lane < query->count; ++lane) {
+            size_t box = query->first + lane;
+            bool hit = (mask >> lane) & 1;
+            Collision single = CheckCollisionCircleBox((mfloat_t*)query->center, BENCH_RADIUS, positions[box], sizes[box]);
+            if (single.hasCollision != hit)
+                ++sqrtDisagreements;
+            if (!hit)
+                continue;
+            ++hits;
+            if ((mask == scalarMask) &&
+                (simd[lane].direction != scalar[lane].direction ||
+                 simd[lane].collisionPoint[0] != scalar[lane].collisionPoint[0] ||
+                 simd[lane].collisionPoint[1] != scalar[lane].collisionPoint[1]))
+                ++mismatches;
+        }
+    }
+
+    size_t tests = 0;
+    for (size_t i = 0; i < BENCH_QUERIES; ++i)
+        tests += queries[i].count;
+    tests *= BENCH_ROUNDS;
+
+    // the sink keeps the compiler from dropping the loops
+    volatile uint32_t sink = 0;
+    double start = now();
+    for (size_t round = 0; round < BENCH_ROUNDS; ++round) {
+        for (size_t i = 0; i < BENCH_QUERIES; ++i) {
+            const Query* query = &queries[i];
+            for (size_t lane = 0; lane < query->count; ++lane) {
+                size_t box = query->first + lane;
+                sink += CheckCollisionCircleBox((mfloat_t*)query->center, BENCH_RADIUS, positions[box], sizes[box]).hasCollision;
+            }
+        }
+    }
+    double single = now() - start;
+
+    start = now();
+    for (size_t round = 0; round < BENCH_ROUNDS; ++round) {
+        for (size_t i = 0; i < BENCH_QUERIES; ++i)
+            sink += CollideCircleBoxesScalar(queries[i].center, BENCH_RADIUS, &boxes, queries[i].first, queries[i].count, scalar);
+    }
+    double scalarTime = now() - start;
+
+    start = now();
+    for (size_t round = 0; round < BENCH_ROUNDS; ++round) {
+        for (size_t i = 0; i < BENCH_QUERIES; ++i)
+            sink += CollideCircleBoxes(queries[i].center, BENCH_RADIUS, &boxes, queries[i].first, queries[i].count, simd);
+    }
+    double kernel = now() - start;
+
+    printf("%zu box tests, %.2f%% hits\n", tests, 100.0 * hits / (tests / BENCH_ROUNDS));
+    printf("%-25s%8.2f ns/box\n", "CheckCollisionCircleBox", single * 1e9 / tests);
+    printf("%-25s%8.2f ns/box\n", "scalar kernel", scalarTime * 1e9 / tests);
+    printf("%-25s%8.2f ns/box  (%s, %.2fx)\n", "batched kernel", kernel * 1e9 / tests, GetCollisionKernelName(), single / kernel);
+    printf("kernel vs scalar mismatches: %zu\n", mismatches);
+    printf("decisions differing from the sqrt test: %zu\n", sqrtDisagreements);
+
+    free(queries);
+    CleanupBoxBatch(&boxes);
+    return mismatches == 0 ? 0 : 1;
+}
@@ -13,11 +13,6 @@ typedef struct {
     bool sticky, passthrough;
 } BallObject;
 
-BallObject* NewBallObject(mfloat_t* pos, float radius, mfloat_t* velocity, Texture2D* sprite);
-void DrawBall(BallObject* ballObj, SpriteRenderer* renderer);
-void CleanupBallObject(BallObject* ballObj);
-
-mfloat_t* MoveBall(BallObject* ballObj, float dt, unsigned int window_width);
-void ResetBall(BallObject* ballObj, mfloat_t* position, mfloat_t* velocity);
+void InitBallObject(BallObject* ball, mfloat_t* pos, float radius, mfloat_t* velocity, Texture2D* sprite);
 
 #endif
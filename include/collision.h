@@ -0,0 +1,53 @@
+#ifndef COLLISION_H_
+#define COLLISION_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mathc.h"
+
+// Most boxes CollideCircleBoxes tests in one call, one bit each in its result
+#define COLLISION_BATCH 32
+
+typedef enum {
+    UP,
+    RIGHT,
+    DOWN,
+    LEFT,
+} Direction;
+
+typedef struct {
+    bool hasCollision;
+    Direction direction;
+    mfloat_t collisionPoint[VEC2_SIZE];  // closest point of the box minus the circle's center
+} Collision;
+
+// Where a moving circle first touches something, time is the fraction of its motion
+typedef struct {
+    float time;
+    mfloat_t normal[VEC2_SIZE];  // unit normal of the touched surface, pointing at the circle
+} Contact;
+
+// Boxes as structure of arrays, so the kernel loads four or eight of them with one instruction
+typedef struct {
+    float* centerX;
+    float* centerY;
+    float* halfWidth;
+    float* halfHeight;
+    size_t count, capacity;
+} BoxBatch;
+
+void InitBoxBatch(BoxBatch* boxes);
+void ClearBoxBatch(BoxBatch* boxes);
+void PushBox(BoxBatch* boxes, const mfloat_t* position, const mfloat_t* size);
+void CleanupBoxBatch(BoxBatch* boxes);
+
+Direction VectorDirection(mfloat_t* target);
+Collision CheckCollisionCircleBox(mfloat_t* center, float radius, const mfloat_t* position, const mfloat_t* size);
+uint32_t CollideCircleBoxes(const mfloat_t* center, float radius, const BoxBatch* boxes, size_t first, size_t count, Collision* collisions);
+uint32_t CollideCircleBoxesScalar(const mfloat_t* center, float radius, const BoxBatch* boxes, size_t first, size_t count, Collision* collisions);
+const char* GetCollisionKernelName();
+bool SweepCircleBox(const mfloat_t* center, float radius, const mfloat_t* motion, const mfloat_t* position, const mfloat_t* size, Contact* contact);
+
+#endif
@@ -2,30 +2,22 @@
 #define GAME_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "collision.h"
 #include "game_object.h"
 #include "mathc.h"
 #include "util.h"
 
+#define GAME_DEFAULT_SAMPLES 4
+#define GAME_DEFAULT_PARTICLES 500
+
 typedef enum {
     GAME_ACTIVE,
     GAME_MENU,
     GAME_WIN,
 } GameState;
 
-typedef enum {
-    UP,
-    RIGHT,
-    DOWN,
-    LEFT,
-} Direction;
-
-typedef struct {
-    bool hasCollision;
-    Direction direction;
-    mfloat_t collisionPoint[VEC2_SIZE];
-} Collision;
-
 typedef struct {
     GameState state;
     bool keys[1024];
@@ -35,18 +27,32 @@ typedef struct {
     unsigned int level;
     DynamicArray powerups;
     unsigned int lives;
+    unsigned int startingBalls;  // balls put on the paddle with every reset, more than one is a stress test
+    unsigned int particles;      // size of the particle pool, read once by InitGame
+    unsigned int drawCalls;
+    unsigned int samples;  // MSAA samples of the scene framebuffer, 0 disables multisampling
+    bool offscreen;        // render without a window, see ReadGameFrame
+    bool showTimings;      // GPU pass timing overlay
 } Game;
 
 Game* NewGame(Game* game, unsigned int width, unsigned int height);
 void InitGame(Game* game);
 void ProcessGameInput(Game* game, float dt);
+void StepGame(Game* game, float dt);
 void UpdateGame(Game* game, float dt);
-void RenderGame(Game* game);
-void DoCollisions(Game* game);
+bool IsGameIdle(Game* game);
+void PublishGameSnapshot(Game* game, uint64_t time);
+bool AcquireGameSnapshot(Game* game, uint64_t* time);
+bool IsGameFrameIdle(Game* game);
+void RenderGame(Game* game, float alpha);
+void DoCollisions(Game* game, float dt);
 void ResetLevel(Game* game);
 void ResetPlayer(Game* game);
-void SpawnPowerUps(Game* game, GameObject* block);
+void SpawnPowerUps(Game* game, mfloat_t* position);
 void UpdatePowerUps(Game* game, float dt);
+void SetGameSamples(Game* game, unsigned int samples);
+void SetGameViewport(Game* game, int width, int height);
+void ReadGameFrame(Game* game, unsigned char* pixels);
 void DetroyGame();
 
 #endif
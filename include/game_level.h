@@ -1,16 +1,67 @@
 #ifndef GAME_LEVEL_H_
 #define GAME_LEVEL_H_
 
+#include <stdint.h>
+
+#include "mathc.h"
+#include "render_queue.h"
 #include "sprite_renderer.h"
 #include "util.h"
 
 typedef struct {
-    DynamicArray bricks;
+    uint8_t tile;     // tile type from the level file, 0 is empty and 1 a solid brick
+    uint8_t palette;  // brick color
+} BrickCell;
+
+// The tile grid of the level file. Bricks are addressed by their tile index in row-major order and
+// their rectangles follow from the grid, so a brick costs two bytes and two bits.
+typedef struct {
+    DynamicArray cells;       // BrickCell per tile
+    DynamicArray standing;    // uint64_t words, bit i is set while tile i holds a brick that is not destroyed
+    DynamicArray solid;       // uint64_t words, bit i is set when the brick in tile i is solid
+    unsigned int columns, rows;
+    mfloat_t origin[VEC2_SIZE];  // top left corner of the first tile
+    float cellWidth, cellHeight;
+    unsigned int generation;  // bumped by every load, the brick layout only changes with it
 } GameLevel;
 
+// What the renderer needs of a level, copied at the end of a simulation tick
+typedef struct {
+    const GameLevel* source;
+    unsigned int generation;
+    DynamicArray bricks;    // SpriteCommand per brick, only re-copied when the layout changes
+    DynamicArray tiles;     // uint32_t tile index of every entry in bricks
+    DynamicArray standing;  // copy of GameLevel.standing
+} LevelSnapshot;
+
+// Render side copy of a level: bricks baked into a static instance buffer and the
+// visibility it currently holds, so only bricks that changed are updated on the GPU
+typedef struct {
+    StaticSprites* sprites;
+    SpriteRenderer* renderer;  // draws sprites once the queue gets to them
+    const GameLevel* source;
+    unsigned int generation;
+    DynamicArray standing;      // per tile like GameLevel.standing
+    DynamicArray spriteOfTile;  // uint32_t index into sprites per tile
+} LevelSprites;
+
 GameLevel* NewGameLevel();
 void LoadLevel(GameLevel* level, const char* file, unsigned int levelWidth, unsigned int levelHeight);
-void DrawLevel(GameLevel* level, SpriteRenderer* renderer);
+void LoadLevelAsync(GameLevel* level, const char* file, unsigned int levelWidth, unsigned int levelHeight);
+void GetBrickRect(const GameLevel* level, size_t index, mfloat_t* position, mfloat_t* size);
+bool IsBrickSolid(const GameLevel* level, size_t index);
+void DestroyBrick(GameLevel* level, size_t index);
+void QueryLevelBricks(const GameLevel* level, const mfloat_t* min, const mfloat_t* max, DynamicArray* indices);
+size_t CountBreakableBricks(const GameLevel* level);
 bool IsLevelCompleted(GameLevel* level);
 
+void InitLevelSnapshot(LevelSnapshot* snapshot);
+void SnapshotLevel(GameLevel* level, LevelSnapshot* snapshot);
+void CleanupLevelSnapshot(LevelSnapshot* snapshot);
+
+void InitLevelSprites(LevelSprites* sprites);
+bool SyncLevelSprites(LevelSprites* sprites, const LevelSnapshot* snapshot, SpriteRenderer* renderer);
+void DrawLevel(LevelSprites* sprites, RenderQueue* queue);
+void CleanupLevelSprites(LevelSprites* sprites);
+
 #endif
@@ -2,11 +2,12 @@
 #define GAME_OBJECT_H_
 
 #include "mathc.h"
-#include "sprite_renderer.h"
+#include "render_queue.h"
 #include "texture.h"
 
 typedef struct {
     mfloat_t position[VEC2_SIZE], size[VEC2_SIZE], velocity[VEC2_SIZE];
+    mfloat_t previousPosition[VEC2_SIZE];  // position at the start of the current simulation tick
     mfloat_t color[VEC3_SIZE];
     float rotation;
     bool isSolid;
@@ -14,8 +15,18 @@ typedef struct {
     Texture2D* sprite;
 } GameObject;
 
+// What the renderer needs of a game object, copied at the end of a simulation tick
+typedef struct {
+    Texture2D* sprite;
+    mfloat_t previousPosition[VEC2_SIZE], position[VEC2_SIZE], size[VEC2_SIZE];
+    mfloat_t color[VEC3_SIZE];
+    float rotation;
+} GameObjectState;
+
 GameObject* NewGameObject(mfloat_t* pos, mfloat_t* size, Texture2D* sprite, mfloat_t* color, mfloat_t* velocity);
-void DrawGameObject(GameObject* gameObj, SpriteRenderer* renderer);
+void SaveGameObjectState(GameObject* gameObj);
+void CaptureGameObject(GameObject* gameObj, GameObjectState* state);
+void DrawGameObject(const GameObjectState* state, RenderQueue* queue, RenderLayer layer, float alpha);
 void CleanupGameObject(GameObject* gameObj);
 
 #endif
@@ -0,0 +1,49 @@
+#ifndef GAME_SNAPSHOT_H_
+#define GAME_SNAPSHOT_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+#include "game_level.h"
+#include "game_object.h"
+#include "sim_timer.h"
+#include "util.h"
+
+#define SNAPSHOT_SLOTS 3
+
+// Everything RenderGame reads of the simulation, filled in after a tick and never modified once published
+typedef struct {
+    bool valid;     // false until the slot was published once
+    uint64_t time;  // GLFW timer value of the tick it was taken after
+    GameState state;
+    unsigned int lives;
+    LevelSnapshot level;
+    GameObjectState player;
+    DynamicArray balls;      // GameObjectState of every ball
+    DynamicArray powerups;   // GameObjectState of every falling power-up
+    DynamicArray particles;  // ParticleState of every live particle
+    bool chaos, confuse, shake;
+    unsigned int samples;
+    bool showTimings;
+    float simTimes[SIM_PHASE_COUNT];  // rolling CPU milliseconds per tick of each simulation phase
+    bool idle;  // nothing in it moves or animates, drawing it again gives the same frame
+} GameSnapshot;
+
+// Lock-free triple buffer between one writer and one reader. The writer fills its own slot and swaps it
+// with the latest one, the reader swaps the latest one for its own only when something new was published.
+// Neither side ever waits and the reader always sees a complete snapshot.
+typedef struct {
+    GameSnapshot slots[SNAPSHOT_SLOTS];
+    atomic_uint latest;  // slot index, SNAPSHOT_FRESH is set while the reader has not taken it yet
+    unsigned int writing, reading;
+} SnapshotBuffer;
+
+void InitSnapshotBuffer(SnapshotBuffer* buffer);
+GameSnapshot* BeginSnapshotWrite(SnapshotBuffer* buffer);
+void PublishSnapshot(SnapshotBuffer* buffer);
+const GameSnapshot* AcquireSnapshot(SnapshotBuffer* buffer);
+void CleanupSnapshotBuffer(SnapshotBuffer* buffer);
+
+#endif
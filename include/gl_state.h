@@ -0,0 +1,46 @@
+#ifndef GL_STATE_H_
+#define GL_STATE_H_
+
+#include <stdbool.h>
+
+// Shadow copy of the GL binding state. Every bind in the renderers goes through here so
+// binds that would not change anything never reach the driver.
+
+#define STATE_MAX_TEXTURE_UNITS 16
+
+typedef enum {
+    STATE_PROGRAM,
+    STATE_ACTIVE_TEXTURE,
+    STATE_TEXTURE,
+    STATE_VERTEX_ARRAY,
+    STATE_BUFFER,
+    STATE_FRAMEBUFFER,
+    STATE_BLEND_FUNC,
+    STATE_KIND_COUNT,
+} StateKind;
+
+typedef struct {
+    unsigned int issued[STATE_KIND_COUNT];
+    unsigned int elided[STATE_KIND_COUNT];
+    unsigned int totalIssued, totalElided;
+} StateStats;
+
+void StateUseProgram(unsigned int program);
+void StateActiveTexture(unsigned int unit);
+void StateBindTexture(unsigned int target, unsigned int texture);
+void StateBindVertexArray(unsigned int vao);
+void StateBindBuffer(unsigned int target, unsigned int buffer);
+void StateBindFramebuffer(unsigned int target, unsigned int framebuffer);
+void StateBlendFunc(unsigned int sfactor, unsigned int dfactor);
+
+void StateDeleteProgram(unsigned int program);
+void StateDeleteTexture(unsigned int texture);
+void StateDeleteVertexArray(unsigned int vao);
+void StateDeleteBuffer(unsigned int buffer);
+void StateDeleteFramebuffer(unsigned int framebuffer);
+
+void ResetStateCache();
+void BeginStateFrame();
+StateStats GetStateStats();
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef GPU_TIMER_H_
+#define GPU_TIMER_H_
+
+#include <stdbool.h>
+
+// GL_TIME_ELAPSED queries around each render pass. Every pass owns one query per buffered frame,
+// results are collected GPU_TIMER_FRAMES frames later so reading them never waits on the GPU.
+
+#define GPU_TIMER_FRAMES 2
+#define GPU_TIMER_HISTORY 120
+
+typedef enum {
+    GPU_PASS_LAYER,    // background and bricks re-rendered into the static layer, only when they changed
+    GPU_PASS_SCENE,    // scene drawn into the multisampled framebuffer
+    GPU_PASS_RESOLVE,  // resolve or present blit
+    GPU_PASS_POST,     // full-screen effect pass
+    GPU_PASS_TEXT,
+    GPU_PASS_COUNT,
+} GpuPass;
+
+void BeginGpuFrame();
+void BeginGpuPass(GpuPass pass);
+void EndGpuPass();
+const char* GetGpuPassName(GpuPass pass);
+float GetGpuPassTime(GpuPass pass);  // rolling average in milliseconds
+float GetGpuFrameTime();             // sum of the pass averages
+bool WriteGpuTimingsCsv(const char* file);
+void CleanupGpuTimers();
+
+#endif
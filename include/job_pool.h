@@ -0,0 +1,21 @@
+#ifndef JOB_POOL_H_
+#define JOB_POOL_H_
+
+#include <stdbool.h>
+
+// Worker threads for CPU-side loading work. A job's run callback executes on any worker, its
+// finish callback on the thread calling FinishJobs, which is where GL uploads belong. Finish
+// callbacks run in submission order as soon as a job and every job before it are done, so a
+// later job may rely on the results of an earlier one.
+
+#define JOB_POOL_MAX_WORKERS 16
+
+typedef void (*JobFunction)(void* data);
+
+void StartJobPool(unsigned int workers);  // 0 picks one worker per core besides the calling thread
+unsigned int GetJobWorkerCount();
+void SubmitJob(JobFunction run, JobFunction finish, void* data);
+void FinishJobs();
+void StopJobPool();
+
+#endif
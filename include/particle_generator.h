@@ -3,19 +3,44 @@
 
 #include "ball_object.h"
 #include "mathc.h"
+#include "render_queue.h"
 #include "shader.h"
 #include "texture.h"
+#include "util.h"
 
+// Size of a particle quad in pixels, compiled into the particle shader as PARTICLE_SCALE
+#define PARTICLE_SCALE 10.0f
+
+// Particle pool stored as parallel arrays, index i across all arrays is one particle
+typedef struct {
+    mfloat_t* positions;   // VEC2_SIZE per particle
+    mfloat_t* previousPositions;  // positions at the start of the current tick, for interpolation
+    mfloat_t* velocities;  // VEC2_SIZE per particle
+    mfloat_t* colors;      // VEC4_SIZE per particle
+    float* life;
+    unsigned int amount;
+} ParticlePool;
+
+// Totals since startup, the headless report divides them by the frames it rendered
+typedef struct {
+    unsigned int draws;       // frames that drew particles
+    size_t instances;         // particles drawn over those frames
+    double packMilliseconds;  // CPU time interpolating, packing and streaming the instances
+} ParticleStats;
+
+// Live particle as handed to the renderer
 typedef struct {
-    mfloat_t position[VEC2_SIZE], velocity[VEC2_SIZE];
+    mfloat_t previousPosition[VEC2_SIZE], position[VEC2_SIZE];
     mfloat_t color[VEC4_SIZE];
-    float life;
-} Particle;
+} ParticleState;
 
-Particle* NewParticle();
 void NewParticleGenerator(Shader shader, Texture2D* texture, unsigned int amount);
-void UpdateParticle(float dt, BallObject* ball, unsigned int newParticles, mfloat_t* offset);
-void DrawParticle();
+void UpdateParticle(float dt, const BallObject* balls, size_t ballCount, unsigned int newParticles, const mfloat_t* offset);
+bool HasLiveParticles();
+void SnapshotParticles(DynamicArray* particles);
+void DrawParticle(RenderQueue* queue, const DynamicArray* particles, float alpha);
+ParticleStats GetParticleStats();
+unsigned int GetParticlePoolSize();
 void CleanupParticles();
 
 #endif
@@ -4,17 +4,39 @@
 #include "shader.h"
 #include "texture.h"
 
+// Effect bits, a mask of them indexes the compiled shader variants
+#define POST_PROCESS_CHAOS 1u
+#define POST_PROCESS_CONFUSE 2u
+#define POST_PROCESS_SHAKE 4u
+#define POST_PROCESS_VARIANTS 8
+
+typedef struct {
+    Shader shader;
+    ShaderUniform timeUniform;
+} PostProcessVariant;
+
 typedef struct {
-    Shader postProcessingShader;
+    PostProcessVariant variants[POST_PROCESS_VARIANTS];
     Texture2D* texture;
     unsigned int width, height;
+    unsigned int viewportWidth, viewportHeight;  // size of the framebuffer the frame is presented to
+    unsigned int samples;  // 0 renders straight into the resolve texture
+    bool offscreen;        // present into an owned framebuffer instead of the default one
     bool confuse, chaos, shake;
+    bool layerValid;  // the static layer still holds the current background and bricks
 } PostProcessor;
 
-PostProcessor* NewPostProcessor(Shader shader, unsigned int width, unsigned int height);
-void BeginPostProcessRender();
+PostProcessor* NewPostProcessor(const char* vShaderFile, const char* fShaderFile, unsigned int width, unsigned int height, unsigned int samples);
+void SetPostProcessSamples(PostProcessor* process, unsigned int samples);
+void SetPostProcessOffscreen(PostProcessor* process, bool offscreen);
+void SetPostProcessViewport(PostProcessor* process, unsigned int width, unsigned int height);
+unsigned int GetPostProcessEffects(PostProcessor* process);
+bool HasPostProcessEffects(PostProcessor* process);
+void BeginPostProcessLayer(PostProcessor* process);
+void BeginPostProcessRender(PostProcessor* process);
 void EndPostProcessRender(PostProcessor* process);
 void RenderPostProcess(PostProcessor* process, float time);
+void ReadPostProcessOutput(PostProcessor* process, unsigned char* pixels);
 void CleanupPostProcess(PostProcessor* process);
 
 #endif
@@ -11,7 +11,6 @@ typedef struct {
 } PowerUp;
 
 PowerUp* NewPowerUp(char* type, mfloat_t* color, float duration, mfloat_t* position, Texture2D* texture);
-void DrawPowerUp(PowerUp* powerup, SpriteRenderer* renderer);
 void CleanupPowerUp(PowerUp* powerup);
 
 #endif
@@ -0,0 +1,61 @@
+#ifndef RENDER_QUEUE_H_
+#define RENDER_QUEUE_H_
+
+#include <stdint.h>
+
+#include "shader.h"
+#include "sprite_renderer.h"
+#include "texture.h"
+#include "util.h"
+
+// Draw items are collected for a whole pass, radix sorted by a 64-bit key and then executed, so items
+// sharing blend mode, shader and texture run back to back. From the most significant bit down the key is
+//   layer (4) | blend (2) | shader (10) | texture (24) | sequence (24)
+// The layer keeps the back to front order, the sequence keeps submission order inside a state group.
+
+typedef enum {
+    RENDER_LAYER_BACKGROUND,
+    RENDER_LAYER_LEVEL,
+    RENDER_LAYER_OBJECTS,  // paddle and power-ups
+    RENDER_LAYER_PARTICLES,
+    RENDER_LAYER_BALL,
+} RenderLayer;
+
+typedef enum {
+    BLEND_ALPHA,
+    BLEND_ADDITIVE,
+} BlendMode;
+
+// Issues the GL calls of an item once the queue has applied its blend mode, shader and texture,
+// returns the number of draw calls it made
+typedef unsigned int (*RenderCallback)(void* data);
+
+typedef struct {
+    uint64_t key;
+    Shader shader;
+    Texture2D* texture;     // NULL leaves texture binding to the callback
+    RenderCallback draw;    // NULL for a sprite, batched with the sprites next to it in one instanced draw
+    void* data;
+    SpriteInstance instance;
+} RenderItem;
+
+typedef struct {
+    uint64_t key;
+    uint32_t item;
+} RenderSortEntry;
+
+typedef struct {
+    SpriteRenderer* sprites;  // draws the sprite items
+    DynamicArray items;       // RenderItem in submission order
+    DynamicArray entries;     // RenderSortEntry, sorted by ExecuteRenderQueue
+    DynamicArray scratch;     // RenderSortEntry, the other half of every radix pass
+    DynamicArray instances;   // SpriteInstance of the sprite items in sorted order
+} RenderQueue;
+
+RenderQueue* NewRenderQueue(SpriteRenderer* sprites);
+void SubmitSpriteItem(RenderQueue* queue, RenderLayer layer, Texture2D* texture, mfloat_t* position, mfloat_t* size, float rotate, mfloat_t* color);
+void SubmitRenderItem(RenderQueue* queue, RenderLayer layer, BlendMode blend, Shader shader, Texture2D* texture, RenderCallback draw, void* data);
+unsigned int ExecuteRenderQueue(RenderQueue* queue);
+void DestroyRenderQueue(RenderQueue* queue);
+
+#endif
@@ -8,11 +8,24 @@
 typedef struct {
     DynamicMap shaders;
     DynamicMap textures;
+    DynamicArray atlasPages;
 } ResourceManager;
 
+typedef struct {
+    const char* file;
+    bool alpha;
+    char* name;
+} TextureSource;
+
 Shader LoadShader(const char* vShaderFile, const char* fShaderFile, const char* gShaderFile, char* name);
+// Compiles the same sources specialized by the given "#define" lines, registered under its own name
+Shader LoadShaderVariant(const char* vShaderFile, const char* fShaderFile, const char* gShaderFile, const char* defines, char* name);
+// Same as LoadShaderVariant with the file reads on a worker, see job_pool.h
+void LoadShaderVariantAsync(const char* vShaderFile, const char* fShaderFile, const char* gShaderFile, const char* defines, char* name);
 Shader GetShader(char* name);
 Texture2D* LoadTexture(const char* file, bool alpha, char* name);
+void LoadTextureAtlas(const TextureSource* sources, size_t count);
+void LoadTextureAtlasAsync(const TextureSource* sources, size_t count);
 Texture2D* GetTexture(char* name);
 void ClearResources();
 
@@ -3,18 +3,41 @@
 
 #include "mathc.h"
 
+// Binding point of the "Matrices" uniform block shared by every program
+#define MATRICES_BLOCK_BINDING 0
+
 typedef unsigned int Shader;
+typedef int ShaderUniform;  // uniform location reflected at link time, -1 when the program has no such uniform
+
+typedef struct {
+    char name[64];
+    ShaderUniform location;
+} ShaderUniformInfo;
+
+typedef struct {
+    Shader program;
+    ShaderUniformInfo* uniforms;
+    unsigned int count;
+} ShaderReflection;
 
-Shader NewShader(const char* vertexSource, const char* fragmentSource, const char* geometrySource);
+// defines holds "#define" lines compiled into every stage, NULL for none
+Shader NewShader(const char* vertexSource, const char* fragmentSource, const char* geometrySource, const char* defines);
+void DeleteShader(Shader shaderID);
 void UseShader(Shader shaderID);
-void setFloat(Shader shaderID, const char* name, float value, bool useShader);
-void setInteger(Shader shaderID, const char* name, int value, bool useShader);
-void setVec2f(Shader shaderID, const char* name, float x, float y, bool useShader);
-void setVec2fv(Shader shaderID, const char* name, mfloat_t* value, bool useShader);
-void setVec3f(Shader shaderID, const char* name, float x, float y, float z, bool useShader);
-void setVec3fv(Shader shaderID, const char* name, mfloat_t* value, bool useShader);
-void setVec4f(Shader shaderID, const char* name, float x, float y, float z, float w, bool useShader);
-void setVec4fv(Shader shaderID, const char* name, mfloat_t* value, bool useShader);
-void setMat4fv(Shader shaderID, const char* name, mfloat_t* matrix, bool useShader);
+ShaderUniform FindUniform(Shader shaderID, const char* name);
+ShaderUniform GetUniform(Shader shaderID, const char* name);
+void SetSharedProjection(mfloat_t* matrix);
+void setFloat(Shader shaderID, ShaderUniform uniform, float value, bool useShader);
+void setInteger(Shader shaderID, ShaderUniform uniform, int value, bool useShader);
+void setVec2f(Shader shaderID, ShaderUniform uniform, float x, float y, bool useShader);
+void setVec2fv(Shader shaderID, ShaderUniform uniform, mfloat_t* value, bool useShader);
+void setVec3f(Shader shaderID, ShaderUniform uniform, float x, float y, float z, bool useShader);
+void setVec3fv(Shader shaderID, ShaderUniform uniform, mfloat_t* value, bool useShader);
+void setVec4f(Shader shaderID, ShaderUniform uniform, float x, float y, float z, float w, bool useShader);
+void setVec4fv(Shader shaderID, ShaderUniform uniform, mfloat_t* value, bool useShader);
+void setMat4fv(Shader shaderID, ShaderUniform uniform, mfloat_t* matrix, bool useShader);
+void setIntegerArray(Shader shaderID, ShaderUniform uniform, int count, int* values, bool useShader);
+void setFloatArray(Shader shaderID, ShaderUniform uniform, int count, float* values, bool useShader);
+void setVec2fArray(Shader shaderID, ShaderUniform uniform, int count, float* values, bool useShader);
 
 #endif
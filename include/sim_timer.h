@@ -0,0 +1,25 @@
+#ifndef SIM_TIMER_H_
+#define SIM_TIMER_H_
+
+// CPU time of each phase of a simulation tick, averaged over the last SIM_TIMER_HISTORY ticks. Only the
+// simulation thread measures, the renderer gets the averages through the snapshot.
+
+#define SIM_TIMER_HISTORY 120
+
+typedef enum {
+    SIM_PHASE_INPUT,
+    SIM_PHASE_BALLS,      // movement, wall, brick and paddle contacts and loss of every ball
+    SIM_PHASE_PARTICLES,
+    SIM_PHASE_POWERUPS,
+    SIM_PHASE_PUBLISH,    // copying the snapshot, counted towards the tick that follows it
+    SIM_PHASE_COUNT,
+} SimPhase;
+
+void BeginSimPhase(SimPhase phase);
+void EndSimPhase();
+void EndSimTick();
+const char* GetSimPhaseName(SimPhase phase);
+float GetSimPhaseTime(SimPhase phase);  // rolling average in milliseconds per tick
+float GetSimTickTime();                 // sum of the phase averages
+
+#endif
@@ -2,15 +2,54 @@
 #define SPRITE_RENDERER_H_
 
 #include "shader.h"
+#include "stream_buffer.h"
 #include "texture.h"
+#include "util.h"
+
+// Per-instance data uploaded to the GPU, matches the instanced attributes in sprite.vs
+typedef struct {
+    float rect[4];  // x, y, width, height
+    float color[3];
+    float rotation;  // radians
+    float uv[4];     // texture sub-rectangle, see Texture2D.uv
+} SpriteInstance;
+
+typedef struct {
+    Texture2D* texture;
+    unsigned int sequence;
+    SpriteInstance instance;
+} SpriteCommand;
+
+typedef struct {
+    Texture2D* texture;
+    size_t first, count;
+} SpriteRun;
+
+// Sprites uploaded once and drawn with one instanced call per texture run
+typedef struct {
+    unsigned int VAO, VBO;
+    DynamicArray runs;
+    SpriteInstance* instances;  // CPU copy in slot order
+    size_t* slots;              // submission index -> slot in the instance buffer
+    size_t count;
+} StaticSprites;
 
 typedef struct {
     Shader shader;
     unsigned int quadVAO;
+    unsigned int quadVBO;
+    StreamBuffer* stream;     // per-frame instance data
+    Texture2D* placeholder;  // plain white, drawn instead of textures whose upload is still pending
+    unsigned int placeholderDraws;  // draws that sampled the placeholder, never reset
 } SpriteRenderer;
 
 SpriteRenderer* NewSpriteRenderer(Shader shader);
-void DrawSprite(SpriteRenderer* renderer, Texture2D* texture, mfloat_t* position, mfloat_t* size, float rotate, mfloat_t* color);
+SpriteCommand MakeSpriteCommand(Texture2D* texture, mfloat_t* position, mfloat_t* size, float rotate, mfloat_t* color);
+void DrawSpriteRun(SpriteRenderer* renderer, Texture2D* texture, size_t offset, size_t first, size_t count);
+StaticSprites* NewStaticSprites(SpriteRenderer* renderer, SpriteCommand* commands, size_t count);
+void SetStaticSpriteVisible(StaticSprites* sprites, size_t index, bool visible);
+unsigned int DrawStaticSprites(SpriteRenderer* renderer, StaticSprites* sprites);
+void DeleteStaticSprites(StaticSprites* sprites);
 void DestroySpriteRenderer(SpriteRenderer* renderer);
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef STREAM_BUFFER_H_
+#define STREAM_BUFFER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Ring buffer for vertex and instance data rewritten every frame. With GL_ARB_buffer_storage the
+// buffer stays persistently and coherently mapped and is split into one segment per frame in flight,
+// a fence guards each segment until the GPU is done reading it. Without it writes are appended with
+// unsynchronized maps and the buffer is orphaned when it fills up.
+
+#define STREAM_BUFFER_SEGMENTS 3
+#define STREAM_BUFFER_ALIGNMENT 16
+
+typedef struct {
+    unsigned int buffer;  // name changes when the buffer grows, re-specify attribute pointers per draw
+    size_t segmentSize;
+    unsigned int segment;  // segment written this frame
+    size_t offset;         // write head inside the segment
+    unsigned char* mapping;
+    void* fences[STREAM_BUFFER_SEGMENTS];  // GLsync per segment, NULL when nothing is pending
+    bool persistent;
+} StreamBuffer;
+
+typedef struct {
+    size_t bytes;             // streamed during the last frame
+    unsigned int fenceWaits;  // segments that were still in use by the GPU when reused
+    double waitMilliseconds;  // time spent blocked on those fences
+} StreamStats;
+
+StreamBuffer* NewStreamBuffer(size_t segmentSize);
+size_t StreamData(StreamBuffer* stream, const void* data, size_t size);
+void BeginStreamFrame();
+StreamStats GetStreamStats();
+bool IsStreamPersistent();
+void DeleteStreamBuffer(StreamBuffer* stream);
+
+#endif
@@ -5,20 +5,33 @@
 #include "shader.h"
 #include "util.h"
 
+#define TEXT_GLYPH_COUNT 128
+
 typedef struct {
-    unsigned int textureID;
+    float uv[4];  // u0, v0, u1, v1 inside the glyph atlas
     mint_t size[VEC2_SIZE];
     mint_t bearing[VEC2_SIZE];
     unsigned int advance;
 } Character;
 
 typedef struct {
-    DynamicMap characters;
+    float position[2];
+    float uv[2];
+    float color[3];
+} TextVertex;
+
+typedef struct {
+    Character characters[TEXT_GLYPH_COUNT];
+    unsigned int atlasTexture;
+    DynamicArray vertices;
     Shader textShader;
 } TextRenderer;
 
-TextRenderer* NewTextRenderer(unsigned int width, unsigned int height);
+TextRenderer* NewTextRenderer();
 void LoadText(TextRenderer* tRenderer, char* font, unsigned int fontSize);
+void LoadTextAsync(TextRenderer* tRenderer, char* font, unsigned int fontSize);
+void QueueText(TextRenderer* tRenderer, char* text, float x, float y, float scale, mfloat_t* color);
+void FlushText(TextRenderer* tRenderer);
 void RenderText(TextRenderer* tRenderer, char* text, float x, float y, float scale, mfloat_t* color);
 
 #endif
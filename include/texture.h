@@ -1,7 +1,14 @@
 #ifndef TEXTURE_H_
 #define TEXTURE_H_
 
-typedef struct {
+#include <stdbool.h>
+
+typedef enum {
+    TEXTURE_READY,
+    TEXTURE_PENDING,  // pixels are still on their way from a pixel buffer, see GenerateTextureAsync
+} TextureStatus;
+
+typedef struct Texture2D {
     unsigned int ID;
     unsigned int width, height;
     unsigned int internalFormat;
@@ -10,10 +17,19 @@ typedef struct {
     unsigned int wrapT;
     unsigned int filterMin;
     unsigned int filterMax;
+    float uv[4];    // u0, v0, u1, v1 of the sampled area
+    bool isRegion;  // sub-rectangle of an atlas page, the ID is owned by the page
+    struct Texture2D* page;  // atlas page of a region, whose status it shares
+    TextureStatus status;
 } Texture2D;
 
 Texture2D* NewTexture();
 void GenerateTexture(Texture2D* texture, unsigned int width, unsigned int height, unsigned char* data);
+void GenerateTextureAsync(Texture2D* texture, unsigned int width, unsigned int height, const unsigned char* data);
+bool IsTextureReady(const Texture2D* texture);
+void PollTextureUploads();
+bool HasPendingTextureUploads();
+void FinishTextureUploads();
 void BindTexture(Texture2D* texture);
 
 #endif
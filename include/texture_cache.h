@@ -0,0 +1,41 @@
+#ifndef TEXTURE_CACHE_H_
+#define TEXTURE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Decoded images kept on disk next to their source as <file>.texcache. A cache file holds the raw
+// pixels behind a small header and is memory mapped on later launches instead of decoding the source
+// again. It is rebuilt whenever the hash of the source bytes no longer matches the one it was made from.
+
+#define TEXTURE_CACHE_EXTENSION ".texcache"
+#define TEXTURE_CACHE_VERSION 1
+
+typedef struct {
+    char magic[4];  // "BTXC"
+    uint32_t version;
+    uint32_t width, height, channels;
+    uint32_t reserved;
+    uint64_t sourceHash;  // FNV-1a of the source file
+} TextureCacheHeader;
+
+typedef struct {
+    const unsigned char* pixels;  // width * height * channels bytes, top row first, read only
+    int width, height, channels;
+    bool cached;  // pixels point into a mapped cache file rather than a fresh decode
+    void* decoded;
+    void* mapping;
+    size_t mappingSize;
+#ifdef _WIN32
+    void* file;
+    void* fileMapping;
+#endif
+} CachedImage;
+
+uint64_t HashBytes(const void* data, size_t size);
+// channels 0 keeps the channel count of the source, like stbi_load
+bool LoadCachedImage(const char* file, int channels, CachedImage* image);
+void ReleaseCachedImage(CachedImage* image);
+
+#endif
@@ -3,42 +3,40 @@ in  vec2  TexCoords;
 out vec4  color;
   
 uniform sampler2D scene;
+
+// Effects are selected at compile time through CHAOS, CONFUSE and SHAKE defines,
+// chaos takes precedence over confuse, which takes precedence over the shake blur
+#if defined(CHAOS) || (defined(SHAKE) && !defined(CONFUSE))
+#define USE_KERNEL
 uniform vec2      offsets[9];
+#endif
+#if defined(CHAOS)
 uniform int       edge_kernel[9];
+#elif defined(SHAKE) && !defined(CONFUSE)
 uniform float     blur_kernel[9];
-
-uniform bool chaos;
-uniform bool confuse;
-uniform bool shake;
+#endif
 
 void main()
 {
+#if defined(USE_KERNEL)
     color = vec4(0.0f);
+    // sample from texture offsets for the convolution matrix
     vec3 sample[9];
-    // sample from texture offsets if using convolution matrix
-    if(chaos || shake)
-        for(int i = 0; i < 9; i++)
-            sample[i] = vec3(texture(scene, TexCoords.st + offsets[i]));
+    for(int i = 0; i < 9; i++)
+        sample[i] = vec3(texture(scene, TexCoords.st + offsets[i]));
+#endif
 
-    // process effects
-    if (chaos)
-    {           
-        for(int i = 0; i < 9; i++)
-            color += vec4(sample[i] * edge_kernel[i], 0.0f);
-        color.a = 1.0f;
-    }
-    else if (confuse)
-    {
-        color = vec4(1.0 - texture(scene, TexCoords).rgb, 1.0);
-    }
-    else if (shake)
-    {
-        for(int i = 0; i < 9; i++)
-            color += vec4(sample[i] * blur_kernel[i], 0.0f);
-        color.a = 1.0f;
-    }
-    else
-    {
-        color =  texture(scene, TexCoords);
-    }
+#if defined(CHAOS)
+    for(int i = 0; i < 9; i++)
+        color += vec4(sample[i] * edge_kernel[i], 0.0f);
+    color.a = 1.0f;
+#elif defined(CONFUSE)
+    color = vec4(1.0 - texture(scene, TexCoords).rgb, 1.0);
+#elif defined(SHAKE)
+    for(int i = 0; i < 9; i++)
+        color += vec4(sample[i] * blur_kernel[i], 0.0f);
+    color.a = 1.0f;
+#else
+    color = texture(scene, TexCoords);
+#endif
 }
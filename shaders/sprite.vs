@@ -1,13 +1,25 @@
 #version 330 core
-layout (location = 0) in vec4 vertex;
+layout (location = 0) in vec4 vertex; // <vec2 position, vec2 texCoords>
+layout (location = 1) in vec4 rect; // <vec2 position, vec2 size>
+layout (location = 2) in vec4 colorRotation; // <vec3 color, float rotation>
+layout (location = 3) in vec4 uvRect; // <vec2 uv0, vec2 uv1> sub-rectangle of the bound texture
 
 out vec2 TexCoords;
+out vec3 SpriteColor;
 
-uniform mat4 model;
-uniform mat4 projection;
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+};
 
 void main()
 {
-    TexCoords = vertex.zw;
-    gl_Position = projection * model * vec4(vertex.xy, 0.0, 1.0);
+    TexCoords = mix(uvRect.xy, uvRect.zw, vertex.zw);
+    SpriteColor = colorRotation.rgb;
+    // rotate around the center of the sprite
+    vec2 local = (vertex.xy - 0.5) * rect.zw;
+    float s = sin(colorRotation.a);
+    float c = cos(colorRotation.a);
+    local = vec2(c * local.x - s * local.y, s * local.x + c * local.y);
+    gl_Position = projection * vec4(rect.xy + 0.5 * rect.zw + local, 0.0, 1.0);
 }
@@ -0,0 +1,302 @@
+#include "collision.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "mathc.h"
+
+void InitBoxBatch(BoxBatch* boxes) {
+    *boxes = (BoxBatch){0};
+}
+
+void ClearBoxBatch(BoxBatch* boxes) {
+    boxes->count = 0;
+}
+
+// Stores center and half extents computed exactly as CheckCollisionCircleBox does
+void PushBox(BoxBatch* boxes, const mfloat_t* position, const mfloat_t* size) {
+    if (boxes->count == boxes->capacity) {
+        size_t capacity = boxes->capacity > 0 ? boxes->capacity * 2 : 64;
+        boxes->centerX = realloc(boxes->centerX, capacity * sizeof(float));
+        boxes->centerY = realloc(boxes->centerY, capacity * sizeof(float));
+        boxes->halfWidth = realloc(boxes->halfWidth, capacity * sizeof(float));
+        boxes->halfHeight = realloc(boxes->halfHeight, capacity * sizeof(float));
+        boxes->capacity = capacity;
+    }
+    size_t i = boxes->count++;
+    boxes->halfWidth[i] = size[0] / 2.0f;
+    boxes->halfHeight[i] = size[1] / 2.0f;
+    boxes->centerX[i] = position[0] + boxes->halfWidth[i];
+    boxes->centerY[i] = position[1] + boxes->halfHeight[i];
+}
+
+void CleanupBoxBatch(BoxBatch* boxes) {
+    free(boxes->centerX);
+    free(boxes->centerY);
+    free(boxes->halfWidth);
+    free(boxes->halfHeight);
+    *boxes = (BoxBatch){0};
+}
+
+Direction VectorDirection(mfloat_t* target) {
+    mfloat_t* compass[4] = {
+        (mfloat_t[VEC2_SIZE]){0.0f, 1.0f},   // up
+        (mfloat_t[VEC2_SIZE]){1.0f, 0.0f},   // right
+        (mfloat_t[VEC2_SIZE]){0.0f, -1.0f},  // down
+        (mfloat_t[VEC2_SIZE]){-1.0f, 0.0f},  // left
+    };
+    float max = 0.0f;
+    unsigned int best_match = 0;
+
+    mfloat_t normalized_target[VEC2_SIZE];
+    vec2_normalize(normalized_target, target);
+
+    for (size_t i = 0; i < 4; i++) {
+        float dot_product = vec2_dot(normalized_target, compass[i]);
+        if (dot_product > max) {
+            max = dot_product;
+            best_match = i;
+        }
+    }
+    return (Direction)best_match;
+}
+
+Collision CheckCollisionCircleBox(mfloat_t* center, float radius, const mfloat_t* position, const mfloat_t* size) {
+    mfloat_t aabb_half_extents[VEC2_SIZE] = {size[0] / 2.0f, size[1] / 2.0f};
+    mfloat_t aabb_center[VEC2_SIZE] = {position[0] + aabb_half_extents[0], position[1] + aabb_half_extents[1]};
+
+    mfloat_t difference[VEC2_SIZE];
+    vec2_subtract(difference, center, aabb_center);
+    mfloat_t clamped[VEC2_SIZE];
+    mfloat_t negative_aabb[VEC2_SIZE];
+    vec2_negative(negative_aabb, aabb_half_extents);
+    vec2_clamp(clamped, difference, negative_aabb, aabb_half_extents);
+
+    mfloat_t closest[VEC2_SIZE];
+    vec2_add(closest, aabb_center, clamped);
+
+    vec2_subtract(difference, closest, center);
+
+    if (vec2_length(difference) < radius) {
+        return (Collision){
+            .hasCollision = true,
+            .direction = VectorDirection(difference),
+            .collisionPoint = {difference[0], difference[1]},
+        };
+    } else {
+        return (Collision){
+            .hasCollision = false,
+            .direction = UP,
+            .collisionPoint = {0.0f, 0.0f},
+        };
+    }
+}
+
+// The kernels below compare squared distances and never take a square root. Every lane runs the same
+// IEEE operations in the same order as collideLane, min and max included, so all of them agree bit for bit.
+
+static bool collideLane(float px, float py, float radiusSquared, const BoxBatch* boxes, size_t box, float* penetrationX, float* penetrationY) {
+    float halfWidth = boxes->halfWidth[box], halfHeight = boxes->halfHeight[box];
+    float dx = px - boxes->centerX[box];
+    float dy = py - boxes->centerY[box];
+    // operand order matches minps and maxps, which return the second operand unless the comparison holds
+    dx = dx < halfWidth ? dx : halfWidth;
+    dy = dy < halfHeight ? dy : halfHeight;
+    dx = dx > -halfWidth ? dx : -halfWidth;
+    dy = dy > -halfHeight ? dy : -halfHeight;
+    *penetrationX = (boxes->centerX[box] + dx) - px;
+    *penetrationY = (boxes->centerY[box] + dy) - py;
+    return *penetrationX * *penetrationX + *penetrationY * *penetrationY < radiusSquared;
+}
+
+// The direction is only worked out for hits, with the same VectorDirection as the single box test
+static void fillCollisions(uint32_t mask, const float* penetrationX, const float* penetrationY, Collision* collisions) {
+    if (!collisions)
+        return;
+    while (mask) {
+        unsigned int lane = __builtin_ctz(mask);
+        Collision* collision = &collisions[lane];
+        collision->hasCollision = true;
+        collision->collisionPoint[0] = penetrationX[lane];
+        collision->collisionPoint[1] = penetrationY[lane];
+        collision->direction = VectorDirection(collision->collisionPoint);
+        mask &= mask - 1;
+    }
+}
+
+// Tests the circle against boxes first to first + count, count at most COLLISION_BATCH. Bit i of the
+// result is set when box first + i is hit, collisions[i] is only written for those. Collisions may be
+// NULL when the mask is all that is needed.
+uint32_t CollideCircleBoxesScalar(const mfloat_t* center, float radius, const BoxBatch* boxes, size_t first, size_t count, Collision* collisions) {
+    float penetrationX[COLLISION_BATCH], penetrationY[COLLISION_BATCH];
+    float radiusSquared = radius * radius;
+    uint32_t mask = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (collideLane(center[0], center[1], radiusSquared, boxes, first + i, &penetrationX[i], &penetrationY[i]))
+            mask |= UINT32_C(1) << i;
+    }
+    fillCollisions(mask, penetrationX, penetrationY, collisions);
+    return mask;
+}
+
+uint32_t CollideCircleBoxes(const mfloat_t* center, float radius, const BoxBatch* boxes, size_t first, size_t count, Collision* collisions) {
+    float penetrationX[COLLISION_BATCH], penetrationY[COLLISION_BATCH];
+    float radiusSquared = radius * radius;
+    uint32_t mask = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 px = _mm256_set1_ps(center[0]), py = _mm256_set1_ps(center[1]);
+    const __m256 r2 = _mm256_set1_ps(radiusSquared);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m256 bx = _mm256_loadu_ps(&boxes->centerX[first + i]);
+        __m256 by = _mm256_loadu_ps(&boxes->centerY[first + i]);
+        __m256 hx = _mm256_loadu_ps(&boxes->halfWidth[first + i]);
+        __m256 hy = _mm256_loadu_ps(&boxes->halfHeight[first + i]);
+        __m256 dx = _mm256_max_ps(_mm256_min_ps(_mm256_sub_ps(px, bx), hx), _mm256_xor_ps(hx, sign));
+        __m256 dy = _mm256_max_ps(_mm256_min_ps(_mm256_sub_ps(py, by), hy), _mm256_xor_ps(hy, sign));
+        __m256 ex = _mm256_sub_ps(_mm256_add_ps(bx, dx), px);
+        __m256 ey = _mm256_sub_ps(_mm256_add_ps(by, dy), py);
+        __m256 distance = _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+        mask |= (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(distance, r2, _CMP_LT_OQ)) << i;
+        _mm256_storeu_ps(&penetrationX[i], ex);
+        _mm256_storeu_ps(&penetrationY[i], ey);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 px = _mm_set1_ps(center[0]), py = _mm_set1_ps(center[1]);
+    const __m128 r2 = _mm_set1_ps(radiusSquared);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 bx = _mm_loadu_ps(&boxes->centerX[first + i]);
+        __m128 by = _mm_loadu_ps(&boxes->centerY[first + i]);
+        __m128 hx = _mm_loadu_ps(&boxes->halfWidth[first + i]);
+        __m128 hy = _mm_loadu_ps(&boxes->halfHeight[first + i]);
+        __m128 dx = _mm_max_ps(_mm_min_ps(_mm_sub_ps(px, bx), hx), _mm_xor_ps(hx, sign));
+        __m128 dy = _mm_max_ps(_mm_min_ps(_mm_sub_ps(py, by), hy), _mm_xor_ps(hy, sign));
+        __m128 ex = _mm_sub_ps(_mm_add_ps(bx, dx), px);
+        __m128 ey = _mm_sub_ps(_mm_add_ps(by, dy), py);
+        __m128 distance = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+        mask |= (uint32_t)_mm_movemask_ps(_mm_cmplt_ps(distance, r2)) << i;
+        _mm_storeu_ps(&penetrationX[i], ex);
+        _mm_storeu_ps(&penetrationY[i], ey);
+    }
+#endif
+    // the tail, or everything without SIMD
+    for (; i < count; ++i) {
+        if (collideLane(center[0], center[1], radiusSquared, boxes, first + i, &penetrationX[i], &penetrationY[i]))
+            mask |= UINT32_C(1) << i;
+    }
+    fillCollisions(mask, penetrationX, penetrationY, collisions);
+    return mask;
+}
+
+const char* GetCollisionKernelName() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__) || defined(_M_X64)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+// A circle moving into a box touches it when its center enters the box grown by the radius with
+// rounded corners. The center's ray is clipped against the grown box first, entering through a corner
+// square means the rounded corner decides. A circle that already overlaps the box and moves further
+// in touches it right away, one moving out does not touch it at all.
+bool SweepCircleBox(const mfloat_t* center, float radius, const mfloat_t* motion, const mfloat_t* position, const mfloat_t* size, Contact* contact) {
+    mfloat_t min[VEC2_SIZE] = {position[0], position[1]};
+    mfloat_t max[VEC2_SIZE] = {position[0] + size[0], position[1] + size[1]};
+
+    mfloat_t closest[VEC2_SIZE], offset[VEC2_SIZE];
+    vec2_clamp(closest, (mfloat_t*)center, min, max);
+    vec2_subtract(offset, (mfloat_t*)center, closest);
+    float distanceSquared = vec2_length_squared(offset);
+    if (distanceSquared < radius * radius) {
+        if (distanceSquared > 0.0f) {
+            vec2_divide_f(contact->normal, offset, sqrtf(distanceSquared));
+        } else {
+            // the center is inside, push it out through the nearest face
+            float faces[4] = {center[0] - min[0], max[0] - center[0], center[1] - min[1], max[1] - center[1]};
+            unsigned int nearest = 0;
+            for (unsigned int i = 1; i < 4; ++i) {
+                if (faces[i] < faces[nearest])
+                    nearest = i;
+            }
+            contact->normal[0] = nearest == 0 ? -1.0f : nearest == 1 ? 1.0f : 0.0f;
+            contact->normal[1] = nearest == 2 ? -1.0f : nearest == 3 ? 1.0f : 0.0f;
+        }
+        contact->time = 0.0f;
+        return vec2_dot((mfloat_t*)motion, contact->normal) < 0.0f;
+    }
+
+    if (motion[0] == 0.0f && motion[1] == 0.0f)
+        return false;
+    // enter may stay behind the start when the center starts in a corner square
+    float enter = -INFINITY, exit = 1.0f;
+    int axis = 0;
+    for (int i = 0; i < 2; ++i) {
+        float low = min[i] - radius, high = max[i] + radius;
+        if (motion[i] == 0.0f) {
+            if (center[i] < low || center[i] > high)
+                return false;
+            continue;
+        }
+        float entry = ((motion[i] > 0.0f ? low : high) - center[i]) / motion[i];
+        float leave = ((motion[i] > 0.0f ? high : low) - center[i]) / motion[i];
+        if (entry > enter) {
+            enter = entry;
+            axis = i;
+        }
+        if (leave < exit)
+            exit = leave;
+        if (enter > exit)
+            return false;
+    }
+
+    if (exit < 0.0f)
+        return false;
+    if (enter < 0.0f)
+        enter = 0.0f;
+
+    mfloat_t point[VEC2_SIZE] = {center[0] + motion[0] * enter, center[1] + motion[1] * enter};
+    bool outsideX = point[0] < min[0] || point[0] > max[0];
+    bool outsideY = point[1] < min[1] || point[1] > max[1];
+    if (!(outsideX && outsideY)) {
+        // the face the point lies beyond, rounding can leave it on neither
+        if (outsideX || outsideY)
+            axis = outsideX ? 0 : 1;
+        contact->time = enter;
+        contact->normal[0] = axis == 0 ? (point[0] < (min[0] + max[0]) / 2.0f ? -1.0f : 1.0f) : 0.0f;
+        contact->normal[1] = axis == 1 ? (point[1] < (min[1] + max[1]) / 2.0f ? -1.0f : 1.0f) : 0.0f;
+        // touching a face while moving along or away from it is no contact
+        return vec2_dot((mfloat_t*)motion, contact->normal) < 0.0f;
+    }
+
+    // a corner square, the ray has to meet the circle around the corner
+    mfloat_t corner[VEC2_SIZE] = {point[0] < min[0] ? min[0] : max[0], point[1] < min[1] ? min[1] : max[1]};
+    mfloat_t fromCorner[VEC2_SIZE];
+    vec2_subtract(fromCorner, (mfloat_t*)center, corner);
+    float a = vec2_dot((mfloat_t*)motion, (mfloat_t*)motion);
+    float b = vec2_dot(fromCorner, (mfloat_t*)motion);
+    float c = vec2_dot(fromCorner, fromCorner) - radius * radius;
+    float discriminant = b * b - a * c;
+    if (b >= 0.0f || discriminant < 0.0f)
+        return false;
+    float time = (-b - sqrtf(discriminant)) / a;
+    if (time > 1.0f)
+        return false;
+    contact->time = time > 0.0f ? time : 0.0f;
+    contact->normal[0] = fromCorner[0] + motion[0] * contact->time;
+    contact->normal[1] = fromCorner[1] + motion[1] * contact->time;
+    vec2_normalize(contact->normal, contact->normal);
+    return true;
+}
@@ -6,13 +6,19 @@
 #include <string.h>
 
 #include "ball_object.h"
+#include "collision.h"
 #include "game_level.h"
 #include "game_object.h"
+#include "game_snapshot.h"
+#include "gpu_timer.h"
+#include "job_pool.h"
 #include "mathc.h"
 #include "particle_generator.h"
 #include "post_processing.h"
 #include "power_up.h"
+#include "render_queue.h"
 #include "resource_manager.h"
+#include "sim_timer.h"
 #include "shader.h"
 #include "sprite_renderer.h"
 #include "text_renderer.h"
@@ -25,39 +31,59 @@ const mfloat_t PLAYER_SIZE[VEC2_SIZE] = {100.0f, 20.0f};
 const float PLAYER_VELOCITY = 500.0f;
 const mfloat_t INITIAL_BALL_VELOCITY[VEC2_SIZE] = {100.0f, -350.0f};
 const float BALL_RADIUS = 12.5f;
+// Most contacts the ball resolves in one tick, whatever motion is left after that is dropped
+#define MAX_BALL_CONTACTS 16
+// Gap left between the ball and what it hit, so the next sweep starts outside of it
+#define CONTACT_SKIN 0.01f
+
+// Spread between the balls a stress start puts on the paddle, in radians either side of straight up
+#define BALL_FAN 1.0f
+// Angle between a ball and the two the multi-ball power-up splits off it, in radians
+#define MULTI_BALL_SPREAD 0.35f
+// Balls the multi-ball power-up splits up to, a stress start may put more in play
+#define MULTI_BALL_LIMIT 256
+
+typedef enum {
+    BALL_CONTACT_NONE,
+    BALL_CONTACT_WALL,
+    BALL_CONTACT_BRICK,
+    BALL_CONTACT_PADDLE,
+} BallContact;
 
 float shakeTime = 0.0f;
 
 static SpriteRenderer* renderer = NULL;
+static RenderQueue* queue = NULL;
 static GameObject* player = NULL;
-static BallObject* ball = NULL;
+// Every ball in play, by value and back to back
+static DynamicArray balls;
 static PostProcessor* effects = NULL;
 static ma_engine engine;
 static ma_sound backgroundMusic;
 static TextRenderer* text = NULL;
 
-static Direction VectorDirection(mfloat_t* target) {
-    mfloat_t* compass[4] = {
-        (mfloat_t[VEC2_SIZE]){0.0f, 1.0f},   // up
-        (mfloat_t[VEC2_SIZE]){1.0f, 0.0f},   // right
-        (mfloat_t[VEC2_SIZE]){0.0f, -1.0f},  // down
-        (mfloat_t[VEC2_SIZE]){-1.0f, 0.0f},  // left
-    };
-    float max = 0.0f;
-    unsigned int best_match = 0;
-
-    mfloat_t normalized_target[VEC2_SIZE];
-    vec2_normalize(normalized_target, target);
-
-    for (size_t i = 0; i < 4; i++) {
-        float dot_product = vec2_dot(normalized_target, compass[i]);
-        if (dot_product > max) {
-            max = dot_product;
-            best_match = i;
-        }
-    }
-    return (Direction)best_match;
-}
+// Post-processing effects as the simulation sees them, handed to the renderer through the snapshot
+static bool chaos = false, confuse = false, shake = false;
+
+// Simulation publishes into snapshots, the renderer only ever reads the one it acquired last
+static SnapshotBuffer snapshots;
+static const GameSnapshot* frame = NULL;
+static LevelSprites levelSprites;
+// Timer value of the first published snapshot, effect shaders count simulated seconds from it
+static uint64_t clockOrigin = 0;
+static bool clockStarted = false;
+
+// Contact sounds are played once per tick however many balls made them
+enum {
+    SOUND_BRICK = 1 << 0,
+    SOUND_SOLID = 1 << 1,
+    SOUND_PADDLE = 1 << 2,
+};
+static unsigned int contactSounds = 0;
+
+// Brick indices along the ball's path and their rectangles, refilled by every sweep
+static DynamicArray candidates;
+static BoxBatch candidateBoxes;
 
 static bool CheckCollisionPowerUp(GameObject* one, PowerUp* two) {
     bool collisionX = one->position[0] + one->size[0] >= two->base.position[0] &&
@@ -67,40 +93,6 @@ static bool CheckCollisionPowerUp(GameObject* one, PowerUp* two) {
     return collisionX && collisionY;
 }
 
-static Collision CheckCollisionBall(BallObject* one, GameObject* two) {
-    mfloat_t center[VEC2_SIZE];
-    vec2_add_f(center, one->base.position, one->radius);
-
-    mfloat_t aabb_half_extents[VEC2_SIZE] = {two->size[0] / 2.0f, two->size[1] / 2.0f};
-    mfloat_t aabb_center[VEC2_SIZE] = {two->position[0] + aabb_half_extents[0], two->position[1] + aabb_half_extents[1]};
-
-    mfloat_t difference[VEC2_SIZE];
-    vec2_subtract(difference, center, aabb_center);
-    mfloat_t clamped[VEC2_SIZE];
-    mfloat_t negative_aabb[VEC2_SIZE];
-    vec2_negative(negative_aabb, aabb_half_extents);
-    vec2_clamp(clamped, difference, negative_aabb, aabb_half_extents);
-
-    mfloat_t closest[VEC2_SIZE];
-    vec2_add(closest, aabb_center, clamped);
-
-    vec2_subtract(difference, closest, center);
-
-    if (vec2_length(difference) < one->radius) {
-        return (Collision){
-            .hasCollision = true,
-            .direction = VectorDirection(difference),
-            .collisionPoint = {difference[0], difference[1]},
-        };
-    } else {
-        return (Collision){
-            .hasCollision = false,
-            .direction = UP,
-            .collisionPoint = {0.0f, 0.0f},
-        };
-    }
-}
-
 static bool isOtherPowerUpActive(DynamicArray* powerups, char* type) {
     DYNAMIC_ARRAY_FOR_EACH_PTR(powerups, PowerUp, powerUp) {
         if ((*powerUp)->activated)
@@ -120,27 +112,65 @@ static bool ShouldSpawn(unsigned int chance) {
     return random == 0;
 }
 
+// Power-ups act on every ball
 static void ActivatePowerUp(PowerUp* powerup) {
     if (strcmp(powerup->type, "speed") == 0) {
-        vec2_multiply_f(ball->base.velocity, ball->base.velocity, 1.2);
+        DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+            vec2_multiply_f(ball->base.velocity, ball->base.velocity, 1.2);
+        }
     } else if (strcmp(powerup->type, "sticky") == 0) {
-        ball->sticky = true;
+        DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+            ball->sticky = true;
+        }
         player->color[0] = 1.0f;
         player->color[1] = 0.5f;
         player->color[2] = 1.0f;
     } else if (strcmp(powerup->type, "pass-through") == 0) {
-        ball->passthrough = true;
-        ball->base.color[0] = 1.0f;
-        ball->base.color[1] = 0.5f;
-        ball->base.color[2] = 0.5f;
+        DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+            ball->passthrough = true;
+            ball->base.color[0] = 1.0f;
+            ball->base.color[1] = 0.5f;
+            ball->base.color[2] = 0.5f;
+        }
     } else if (strcmp(powerup->type, "pad-size-increase") == 0) {
         player->size[0] += 50;
     } else if (strcmp(powerup->type, "confuse") == 0) {
-        if (!effects->chaos)
-            effects->confuse = true;
+        if (!chaos)
+            confuse = true;
     } else if (strcmp(powerup->type, "chaos") == 0) {
-        if (!effects->confuse)
-            effects->chaos = true;
+        if (!confuse)
+            chaos = true;
+    } else if (strcmp(powerup->type, "multi-ball") == 0) {
+        // every ball in play splits in three, the new ones turned to either side
+        size_t count = balls.size;
+        for (size_t i = 0; i < count && balls.size + 2 <= MULTI_BALL_LIMIT; ++i) {
+            if (((BallObject*)balls.array)[i].stuck)
+                continue;
+            for (int side = -1; side <= 1; side += 2) {
+                // copied before every push, which may move the array
+                BallObject split = ((BallObject*)balls.array)[i];
+                vec2_rotate(split.base.velocity, split.base.velocity, side * MULTI_BALL_SPREAD);
+                push(&balls, &split);
+            }
+        }
+    }
+}
+
+// Puts the game's starting balls on the paddle. Past the first they fan out to either side of the
+// usual launch direction at the same speed.
+static void spawnBalls(Game* game) {
+    mfloat_t ballPos[VEC2_SIZE];
+    vec2_add(ballPos, player->position, (mfloat_t[]){PLAYER_SIZE[0] / 2.0f - BALL_RADIUS, -(BALL_RADIUS * 2.0f)});
+    clearArray(&balls, NULL);
+    unsigned int count = game->startingBalls > 0 ? game->startingBalls : 1;
+    for (unsigned int i = 0; i < count; ++i) {
+        mfloat_t velocity[VEC2_SIZE];
+        vec2_assign(velocity, (mfloat_t*)INITIAL_BALL_VELOCITY);
+        if (count > 1)
+            vec2_rotate(velocity, velocity, BALL_FAN * (2.0f * i / (count - 1) - 1.0f));
+        BallObject ball;
+        InitBallObject(&ball, ballPos, BALL_RADIUS, velocity, GetTexture("face"));
+        push(&balls, &ball);
     }
 }
 
@@ -152,77 +182,111 @@ Game* NewGame(Game* game, unsigned int width, unsigned int height) {
         .keys = {false},
         .keysProcessed = {false},
         .lives = 3,
+        .samples = GAME_DEFAULT_SAMPLES,
+        .startingBalls = 1,
+        .particles = GAME_DEFAULT_PARTICLES,
     };
     initialize(&game->levels, 4, sizeof(GameLevel*));
     initialize(&game->powerups, 128, sizeof(PowerUp*));
     return game;
 }
 
+static void startAudio(void* data __attribute__((unused))) {
+    ma_engine_init(NULL, &engine);
+    ma_sound_init_from_file(&engine, "audio/breakout.mp3", MA_SOUND_FLAG_STREAM, NULL, NULL, &backgroundMusic);
+    ma_sound_set_looping(&backgroundMusic, MA_TRUE);
+    ma_sound_start(&backgroundMusic);
+}
+
 void InitGame(Game* game) {
+    // File reads, decoding, parsing and rasterization fan out over the job pool. GL uploads run on
+    // this thread inside FinishJobs, in submission order, so levels see the textures they use.
+    StartJobPool(0);
     // Load shaders
-    Shader spriteShaderId = LoadShader("shaders/sprite.vs", "shaders/sprite.frag", NULL, "sprite");
-    Shader particleShaderId = LoadShader("shaders/particle.vs", "shaders/particle.frag", NULL, "particle");
-    Shader effectsShaderId = LoadShader("shaders/post_processing.vs", "shaders/post_processing.frag", NULL, "postprocessing");
-    // Configure shaders
-    mfloat_t projection[MAT4_SIZE];
-    mat4_ortho(projection, 0.0f, (float)game->width, (float)game->height, 0.0f, -1.0f, 1.0f);
-    UseShader(spriteShaderId);
-    setInteger(spriteShaderId, "image", 0, false);
-    setMat4fv(spriteShaderId, "projection", projection, false);
-    UseShader(particleShaderId);
-    setInteger(particleShaderId, "sprite", 0, false);
-    setMat4fv(particleShaderId, "projection", projection, false);
-    // Load textures
-    LoadTexture("textures/background.jpg", false, "background");
-    LoadTexture("textures/awesomeface.png", true, "face");
-    LoadTexture("textures/block.png", false, "block");
-    LoadTexture("textures/block_solid.png", false, "block_solid");
-    LoadTexture("textures/paddle.png", true, "paddle");
-    LoadTexture("textures/particle.png", true, "particle");
-    LoadTexture("textures/powerup_speed.png", true, "powerup_speed");
-    LoadTexture("textures/powerup_sticky.png", true, "powerup_sticky");
-    LoadTexture("textures/powerup_increase.png", true, "powerup_increase");
-    LoadTexture("textures/powerup_confuse.png", true, "powerup_confuse");
-    LoadTexture("textures/powerup_chaos.png", true, "powerup_chaos");
-    LoadTexture("textures/powerup_passthrough.png", true, "powerup_passthrough");
-    // Set render-specific controls
-    renderer = NewSpriteRenderer(spriteShaderId);
-    NewParticleGenerator(particleShaderId, GetTexture("particle"), 500);
-    effects = NewPostProcessor(effectsShaderId, game->width, game->height);
+    LoadShaderVariantAsync("shaders/sprite.vs", "shaders/sprite.frag", NULL, NULL, "sprite");
+    char particleDefines[64];
+    snprintf(particleDefines, sizeof(particleDefines), "#define PARTICLE_SCALE %f\n", PARTICLE_SCALE);
+    LoadShaderVariantAsync("shaders/particle.vs", "shaders/particle.frag", NULL, particleDefines, "particle");
+    // Load textures into a shared atlas so game sprites draw from a single bound texture
+    const TextureSource textures[] = {
+        {"textures/background.jpg", false, "background"},
+        {"textures/awesomeface.png", true, "face"},
+        {"textures/block.png", false, "block"},
+        {"textures/block_solid.png", false, "block_solid"},
+        {"textures/paddle.png", true, "paddle"},
+        {"textures/particle.png", true, "particle"},
+        {"textures/powerup_speed.png", true, "powerup_speed"},
+        {"textures/powerup_sticky.png", true, "powerup_sticky"},
+        {"textures/powerup_increase.png", true, "powerup_increase"},
+        {"textures/powerup_confuse.png", true, "powerup_confuse"},
+        {"textures/powerup_chaos.png", true, "powerup_chaos"},
+        {"textures/powerup_passthrough.png", true, "powerup_passthrough"},
+        {"textures/powerup_multiball.png", true, "powerup_multiball"},
+    };
+    LoadTextureAtlasAsync(textures, sizeof(textures) / sizeof(textures[0]));
     // Load levels
     GameLevel* one = NewGameLevel();
-    LoadLevel(one, "levels/one.lvl", game->width, game->height / 2);
+    LoadLevelAsync(one, "levels/one.lvl", game->width, game->height / 2);
     GameLevel* two = NewGameLevel();
-    LoadLevel(two, "levels/two.lvl", game->width, game->height / 2);
+    LoadLevelAsync(two, "levels/two.lvl", game->width, game->height / 2);
     GameLevel* three = NewGameLevel();
-    LoadLevel(three, "levels/three.lvl", game->width, game->height / 2);
+    LoadLevelAsync(three, "levels/three.lvl", game->width, game->height / 2);
     GameLevel* four = NewGameLevel();
-    LoadLevel(four, "levels/four.lvl", game->width, game->height / 2);
+    LoadLevelAsync(four, "levels/four.lvl", game->width, game->height / 2);
     pushPtr(&game->levels, one);
     pushPtr(&game->levels, two);
     pushPtr(&game->levels, three);
     pushPtr(&game->levels, four);
     game->level = 0;
+    // Text
+    text = NewTextRenderer();
+    LoadTextAsync(text, "fonts/ocraext.TTF", 24);
+    // Audio
+    SubmitJob(startAudio, NULL, NULL);
+    // The post processor compiles its own shaders here while the workers are busy
+    effects = NewPostProcessor("shaders/post_processing.vs", "shaders/post_processing.frag", game->width, game->height, game->samples);
+    if (game->offscreen)
+        SetPostProcessOffscreen(effects, true);
+    FinishJobs();
+    StopJobPool();
+
+    // Configure shaders
+    Shader spriteShaderId = GetShader("sprite");
+    Shader particleShaderId = GetShader("particle");
+    mfloat_t projection[MAT4_SIZE];
+    mat4_ortho(projection, 0.0f, (float)game->width, (float)game->height, 0.0f, -1.0f, 1.0f);
+    SetSharedProjection(projection);
+    setInteger(spriteShaderId, GetUniform(spriteShaderId, "image"), 0, true);
+    setInteger(particleShaderId, GetUniform(particleShaderId, "sprite"), 0, true);
+    // Set render-specific controls
+    renderer = NewSpriteRenderer(spriteShaderId);
+    queue = NewRenderQueue(renderer);
+    NewParticleGenerator(particleShaderId, GetTexture("particle"), game->particles);
+    InitSnapshotBuffer(&snapshots);
+    InitLevelSprites(&levelSprites);
+    initialize(&candidates, 32, sizeof(size_t));
+    InitBoxBatch(&candidateBoxes);
     // Configure game objects
     mfloat_t playerPos[VEC2_SIZE] = {
         game->width / 2.0f - PLAYER_SIZE[0] / 2.0f,
         game->height - PLAYER_SIZE[1]  // #
     };
     player = NewGameObject(playerPos, (mfloat_t*)PLAYER_SIZE, GetTexture("paddle"), NULL, NULL);
-    mfloat_t ballPos[VEC2_SIZE];
-    vec2_add(ballPos, playerPos, (mfloat_t[VEC2_SIZE]){PLAYER_SIZE[0] / 2.0f - BALL_RADIUS, -BALL_RADIUS * 2.0f});
-    ball = NewBallObject(ballPos, BALL_RADIUS, (mfloat_t*)INITIAL_BALL_VELOCITY, GetTexture("face"));
-    // Audio
-    ma_engine_init(NULL, &engine);
-    ma_sound_init_from_file(&engine, "audio/breakout.mp3", MA_SOUND_FLAG_STREAM, NULL, NULL, &backgroundMusic);
-    ma_sound_set_looping(&backgroundMusic, MA_TRUE);
-    ma_sound_start(&backgroundMusic);
-    // Text
-    text = NewTextRenderer(game->width, game->height);
-    LoadText(text, "fonts/ocraext.TTF", 24);
+    initialize(&balls, 16, sizeof(BallObject));
+    spawnBalls(game);
 }
 
 void ProcessGameInput(Game* game, float dt) {
+    // F3 toggles the GPU timing overlay
+    if (game->keys[GLFW_KEY_F3] && !game->keysProcessed[GLFW_KEY_F3]) {
+        game->showTimings = !game->showTimings;
+        game->keysProcessed[GLFW_KEY_F3] = true;
+    }
+    // M cycles the MSAA sample count: off, 2, 4, 8
+    if (game->keys[GLFW_KEY_M] && !game->keysProcessed[GLFW_KEY_M]) {
+        SetGameSamples(game, game->samples >= 8 ? 0 : (game->samples == 0 ? 2 : game->samples * 2));
+        game->keysProcessed[GLFW_KEY_M] = true;
+    }
     if (game->state == GAME_MENU) {
         if (game->keys[GLFW_KEY_ENTER] && !game->keysProcessed[GLFW_KEY_ENTER]) {
             game->state = GAME_ACTIVE;
@@ -244,7 +308,7 @@ void ProcessGameInput(Game* game, float dt) {
     if (game->state == GAME_WIN) {
         if (game->keys[GLFW_KEY_ENTER]) {
             game->keysProcessed[GLFW_KEY_ENTER] = true;
-            effects->chaos = false;
+            chaos = false;
             game->state = GAME_MENU;
         }
     }
@@ -254,39 +318,81 @@ void ProcessGameInput(Game* game, float dt) {
         if (game->keys[GLFW_KEY_A]) {
             if (player->position[0] >= 0.0f) {
                 player->position[0] -= velocity;
-                if (ball->stuck)
-                    ball->base.position[0] -= velocity;
+                DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+                    if (ball->stuck)
+                        ball->base.position[0] -= velocity;
+                }
             }
         }
         if (game->keys[GLFW_KEY_D]) {
             if (player->position[0] <= game->width - player->size[0]) {
                 player->position[0] += velocity;
-                if (ball->stuck)
-                    ball->base.position[0] += velocity;
+                DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+                    if (ball->stuck)
+                        ball->base.position[0] += velocity;
+                }
+            }
+        }
+        if (game->keys[GLFW_KEY_SPACE]) {
+            DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+                ball->stuck = false;
             }
         }
-        if (game->keys[GLFW_KEY_SPACE])
-            ball->stuck = false;
     }
 }
 
+// One fixed simulation tick. Positions are saved first so rendering can interpolate
+// between this tick and the previous one.
+void StepGame(Game* game, float dt) {
+    SaveGameObjectState(player);
+    DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+        SaveGameObjectState(&ball->base);
+    }
+    DYNAMIC_ARRAY_FOR_EACH_PTR(&game->powerups, PowerUp, powerUp) {
+        SaveGameObjectState(&(*powerUp)->base);
+    }
+    BeginSimPhase(SIM_PHASE_INPUT);
+    ProcessGameInput(game, dt);
+    EndSimPhase();
+    UpdateGame(game, dt);
+    EndSimTick();
+}
+
+// Drops the balls that fell off the bottom, keeping the others in order. True when none is left.
+static bool removeLostBalls(Game* game) {
+    BallObject* all = (BallObject*)balls.array;
+    size_t kept = 0;
+    for (size_t i = 0; i < balls.size; ++i) {
+        if (all[i].base.position[1] < game->height)
+            all[kept++] = all[i];
+    }
+    if (kept < balls.size)
+        erase(&balls, kept, balls.size);
+    return kept == 0;
+}
+
 void UpdateGame(Game* game, float dt) {
-    // Update objects
-    MoveBall(ball, dt, game->width);
-    // Check for collisions
-    DoCollisions(game);
-    // Update particles
-    UpdateParticle(dt, ball, 2, (mfloat_t[VEC2_SIZE]){ball->radius / 2.0f, ball->radius / 2.0f});
+    // Move the balls and resolve what they run into on the way
+    DoCollisions(game, dt);
+    // Update particles, balls only trail them while in play
+    BeginSimPhase(SIM_PHASE_PARTICLES);
+    UpdateParticle(dt, (const BallObject*)balls.array, balls.size, game->state == GAME_ACTIVE ? 2 : 0, (mfloat_t[VEC2_SIZE]){BALL_RADIUS / 2.0f, BALL_RADIUS / 2.0f});
+    EndSimPhase();
     // Update powerups
+    BeginSimPhase(SIM_PHASE_POWERUPS);
     UpdatePowerUps(game, dt);
+    EndSimPhase();
     // Reduce shake time
     if (shakeTime > 0.0f) {
         shakeTime -= dt;
         if (shakeTime <= 0.0f)
-            effects->shake = false;
+            shake = false;
     }
-    // Check loss condition
-    if (ball->base.position[1] >= game->height) {
+    // Check loss condition, a life is lost with the last ball
+    BeginSimPhase(SIM_PHASE_BALLS);
+    bool lost = removeLostBalls(game);
+    EndSimPhase();
+    if (lost) {
         --game->lives;
         if (game->lives == 0) {
             ResetLevel(game);
@@ -299,89 +405,333 @@ void UpdateGame(Game* game, float dt) {
     if (game->state == GAME_ACTIVE && IsLevelCompleted(level)) {
         ResetLevel(game);
         ResetPlayer(game);
-        effects->chaos = true;
+        chaos = true;
         game->state = GAME_WIN;
     }
 }
 
-void RenderGame(Game* game) {
-    if (game->state == GAME_ACTIVE || game->state == GAME_MENU || game->state == GAME_WIN) {
-        BeginPostProcessRender();
-        // Draw background
-        DrawSprite(
-            renderer,
-            GetTexture("background"),
-            (mfloat_t[VEC2_SIZE]){0.0f, 0.0f},
-            (mfloat_t[VEC2_SIZE]){game->height, game->width},
-            0.0f,
-            NULL  // #
-        );
-        // Draw level
-        GameLevel* level = ((GameLevel**)(game->levels.array))[game->level];
-        DrawLevel(level, renderer);
-        // Draw player
-        DrawGameObject(player, renderer);
-        DYNAMIC_ARRAY_FOR_EACH_PTR(&game->powerups, PowerUp, powerUp) {
-            if (!(*powerUp)->base.destroyed)
-                DrawPowerUp(*powerUp, renderer);
+// True when further ticks would change nothing on screen until the next input: out of play, no effect
+// running and nothing left moving. The main loop then stops ticking and the renderer stops drawing.
+bool IsGameIdle(Game* game) {
+    if (game->state == GAME_ACTIVE || chaos || confuse || shake || HasLiveParticles())
+        return false;
+    DYNAMIC_ARRAY_FOR_EACH_PTR(&game->powerups, PowerUp, powerUp) {
+        if (!(*powerUp)->base.destroyed)
+            return false;
+    }
+    return true;
+}
+
+// Copies what the renderer needs out of the simulation and publishes it, never blocks on the render thread
+void PublishGameSnapshot(Game* game, uint64_t time) {
+    BeginSimPhase(SIM_PHASE_PUBLISH);
+    GameSnapshot* snapshot = BeginSnapshotWrite(&snapshots);
+    if (!clockStarted) {
+        clockOrigin = time;
+        clockStarted = true;
+    }
+    snapshot->time = time;
+    snapshot->state = game->state;
+    snapshot->lives = game->lives;
+    SnapshotLevel(((GameLevel**)(game->levels.array))[game->level], &snapshot->level);
+    CaptureGameObject(player, &snapshot->player);
+    clearArray(&snapshot->balls, NULL);
+    DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+        GameObjectState state;
+        CaptureGameObject(&ball->base, &state);
+        push(&snapshot->balls, &state);
+    }
+    clearArray(&snapshot->powerups, NULL);
+    DYNAMIC_ARRAY_FOR_EACH_PTR(&game->powerups, PowerUp, powerUp) {
+        if (!(*powerUp)->base.destroyed) {
+            GameObjectState state;
+            CaptureGameObject(&(*powerUp)->base, &state);
+            push(&snapshot->powerups, &state);
+        }
+    }
+    SnapshotParticles(&snapshot->particles);
+    snapshot->chaos = chaos;
+    snapshot->confuse = confuse;
+    snapshot->shake = shake;
+    snapshot->samples = game->samples;
+    snapshot->showTimings = game->showTimings;
+    snapshot->idle = IsGameIdle(game);
+    for (SimPhase phase = 0; phase < SIM_PHASE_COUNT; ++phase)
+        snapshot->simTimes[phase] = GetSimPhaseTime(phase);
+    PublishSnapshot(&snapshots);
+    EndSimPhase();
+}
+
+// Latches the newest published snapshot for RenderGame, false while nothing was published yet
+bool AcquireGameSnapshot(Game* game __attribute__((unused)), uint64_t* time) {
+    const GameSnapshot* snapshot = AcquireSnapshot(&snapshots);
+    if (!snapshot)
+        return false;
+    frame = snapshot;
+    if (time)
+        *time = frame->time;
+    return true;
+}
+
+// Whether the acquired snapshot was published by an idle simulation
+bool IsGameFrameIdle(Game* game __attribute__((unused))) {
+    return frame && frame->idle;
+}
+
+// Draws the acquired snapshot, alpha places it between the tick before and the one it was taken after
+void RenderGame(Game* game, float alpha) {
+    if (!frame)
+        return;
+    if (frame->samples != effects->samples)
+        SetPostProcessSamples(effects, frame->samples);
+    effects->chaos = frame->chaos;
+    effects->confuse = frame->confuse;
+    effects->shake = frame->shake;
+
+    if (frame->state == GAME_ACTIVE || frame->state == GAME_MENU || frame->state == GAME_WIN) {
+        unsigned int drawCalls = 0;
+        // Background and bricks only change when a brick is destroyed or a level is loaded,
+        // the rest of the time the scene starts from the cached static layer
+        if (SyncLevelSprites(&levelSprites, &frame->level, renderer) || !effects->layerValid) {
+            BeginGpuPass(GPU_PASS_LAYER);
+            BeginPostProcessLayer(effects);
+            unsigned int placeholders = renderer->placeholderDraws;
+            // Draw background
+            SubmitSpriteItem(
+                queue,
+                RENDER_LAYER_BACKGROUND,
+                GetTexture("background"),
+                (mfloat_t[VEC2_SIZE]){0.0f, 0.0f},
+                (mfloat_t[VEC2_SIZE]){game->height, game->width},
+                0.0f,
+                NULL  // #
+            );
+            // Draw level
+            DrawLevel(&levelSprites, queue);
+            drawCalls += ExecuteRenderQueue(queue);
+            // a layer drawn while textures were still uploading is redrawn once they arrive
+            effects->layerValid = renderer->placeholderDraws == placeholders;
+            EndGpuPass();
         }
-        // Draw particles
-        DrawParticle();
-        // Draw ball
-        DrawBall(ball, renderer);
+        BeginGpuPass(GPU_PASS_SCENE);
+        BeginPostProcessRender(effects);
+        // Layers keep the draw order, inside a layer the queue orders by state
+        DrawGameObject(&frame->player, queue, RENDER_LAYER_OBJECTS, alpha);
+        DYNAMIC_ARRAY_FOR_EACH(&frame->powerups, GameObjectState, powerUp) {
+            DrawGameObject(powerUp, queue, RENDER_LAYER_OBJECTS, alpha);
+        }
+        DrawParticle(queue, &frame->particles, alpha);
+        DYNAMIC_ARRAY_FOR_EACH(&frame->balls, GameObjectState, ball) {
+            DrawGameObject(ball, queue, RENDER_LAYER_BALL, alpha);
+        }
+        drawCalls += ExecuteRenderQueue(queue);
+        game->drawCalls = drawCalls;
+        EndGpuPass();
+        BeginGpuPass(GPU_PASS_RESOLVE);
         EndPostProcessRender(effects);
-        RenderPostProcess(effects, glfwGetTime());
+        EndGpuPass();
+        if (HasPostProcessEffects(effects)) {
+            BeginGpuPass(GPU_PASS_POST);
+            // simulated rather than wall clock time, so headless runs stay reproducible with effects active
+            RenderPostProcess(effects, (frame->time - clockOrigin) / (double)glfwGetTimerFrequency());
+            EndGpuPass();
+        }
 
         char buffer[32];
-        snprintf(buffer, sizeof(buffer), "Lives:%u", game->lives);
-        RenderText(text, buffer, 5.0f, 5.0f, 1.0f, NULL);
+        snprintf(buffer, sizeof(buffer), "Lives:%u", frame->lives);
+        QueueText(text, buffer, 5.0f, 5.0f, 1.0f, NULL);
     }
-    if (game->state == GAME_MENU) {
-        RenderText(text, "Press ENTER to start", 490.0f, game->height / 2.0f, 1.0f, NULL);
-        RenderText(text, "Press W or S to select level", 485.0f, game->height / 2.0f + 20.0f, 0.75f, NULL);
+    if (frame->state == GAME_MENU) {
+        QueueText(text, "Press ENTER to start", 490.0f, game->height / 2.0f, 1.0f, NULL);
+        QueueText(text, "Press W or S to select level", 485.0f, game->height / 2.0f + 20.0f, 0.75f, NULL);
     }
-    if (game->state == GAME_WIN) {
-        RenderText(text, "You WON!!!", 560.0f, game->height / 2.0f - 20.0f, 1.0f, (mfloat_t[VEC3_SIZE]){0.0f, 1.0f, 0.0f});
-        RenderText(text, "Press ENTER to retry or ESC to quit", 370.0f, game->height / 2.0f, 1.0f, (mfloat_t[VEC3_SIZE]){1.0f, 1.0f, 0.0f});
+    if (frame->state == GAME_WIN) {
+        QueueText(text, "You WON!!!", 560.0f, game->height / 2.0f - 20.0f, 1.0f, (mfloat_t[VEC3_SIZE]){0.0f, 1.0f, 0.0f});
+        QueueText(text, "Press ENTER to retry or ESC to quit", 370.0f, game->height / 2.0f, 1.0f, (mfloat_t[VEC3_SIZE]){1.0f, 1.0f, 0.0f});
+    }
+    if (frame->showTimings) {
+        // rolling GPU cost per pass, in the top right corner
+        char line[48];
+        for (GpuPass pass = 0; pass < GPU_PASS_COUNT; ++pass) {
+            snprintf(line, sizeof(line), "%-8s%6.2f ms", GetGpuPassName(pass), GetGpuPassTime(pass));
+            QueueText(text, line, game->width - 230.0f, 5.0f + 18.0f * pass, 0.7f, (mfloat_t[VEC3_SIZE]){1.0f, 1.0f, 0.0f});
+        }
+        snprintf(line, sizeof(line), "%-8s%6.2f ms", "gpu", GetGpuFrameTime());
+        QueueText(text, line, game->width - 230.0f, 5.0f + 18.0f * GPU_PASS_COUNT, 0.7f, (mfloat_t[VEC3_SIZE]){1.0f, 1.0f, 0.0f});
+        // simulation cost per tick below, as of the snapshot
+        float tick = 0.0f;
+        for (SimPhase phase = 0; phase < SIM_PHASE_COUNT; ++phase) {
+            snprintf(line, sizeof(line), "%-9s%6.2f ms", GetSimPhaseName(phase), frame->simTimes[phase]);
+            QueueText(text, line, game->width - 230.0f, 14.0f + 18.0f * (GPU_PASS_COUNT + 1 + phase), 0.7f, (mfloat_t[VEC3_SIZE]){0.5f, 1.0f, 0.5f});
+            tick += frame->simTimes[phase];
+        }
+        snprintf(line, sizeof(line), "%-9s%6.2f ms", "tick", tick);
+        QueueText(text, line, game->width - 230.0f, 14.0f + 18.0f * (GPU_PASS_COUNT + 1 + SIM_PHASE_COUNT), 0.7f, (mfloat_t[VEC3_SIZE]){0.5f, 1.0f, 0.5f});
+        snprintf(line, sizeof(line), "%-9s%6zu", "balls", frame->balls.size);
+        QueueText(text, line, game->width - 230.0f, 14.0f + 18.0f * (GPU_PASS_COUNT + 2 + SIM_PHASE_COUNT), 0.7f, (mfloat_t[VEC3_SIZE]){0.5f, 1.0f, 0.5f});
     }
+    BeginGpuPass(GPU_PASS_TEXT);
+    FlushText(text);
+    EndGpuPass();
 }
 
-void DoCollisions(Game* game) {
-    GameLevel* level = ((GameLevel**)(game->levels.array))[game->level];
-    DYNAMIC_ARRAY_FOR_EACH_PTR(&level->bricks, GameObject, box) {
-        if (!(*box)->destroyed) {
-            Collision collision = CheckCollisionBall(ball, *box);
-            if (collision.hasCollision) {
-                if (!(*box)->isSolid) {
-                    (*box)->destroyed = true;
-                    SpawnPowerUps(game, *box);
-                    ma_engine_play_sound(&engine, "audio/bleep.mp3", NULL);
-                } else {
-                    shakeTime = 0.05f;
-                    effects->shake = true;
-                    ma_engine_play_sound(&engine, "audio/solid.wav", NULL);
-                }
+static bool sweepWalls(const mfloat_t* center, float radius, const mfloat_t* motion, float width, Contact* contact) {
+    // the wall planes as the ball's center meets them, there is none at the bottom
+    const float planes[3] = {radius, width - radius, radius};
+    const mfloat_t normals[3][VEC2_SIZE] = {{1.0f, 0.0f}, {-1.0f, 0.0f}, {0.0f, 1.0f}};
+    const unsigned int axes[3] = {0, 0, 1};
+    bool found = false;
+    for (unsigned int i = 0; i < 3; ++i) {
+        float toward = motion[axes[i]] * normals[i][axes[i]];
+        if (toward >= 0.0f)
+            continue;
+        float time = (planes[i] - center[axes[i]]) / motion[axes[i]];
+        time = time > 0.0f ? time : 0.0f;
+        if (time <= 1.0f && (!found || time < contact->time)) {
+            contact->time = time;
+            vec2_assign(contact->normal, (mfloat_t*)normals[i]);
+            found = true;
+        }
+    }
+    return found;
+}
 
-                if (!(ball->passthrough && !(*box)->isSolid)) {
-                    if (collision.direction == LEFT || collision.direction == RIGHT) {
-                        ball->base.velocity[0] = -ball->base.velocity[0];
-                        float penetration = ball->radius - MFABS(collision.collisionPoint[0]);
-                        if (collision.direction == LEFT)
-                            ball->base.position[0] += penetration;
-                        else
-                            ball->base.position[0] -= penetration;
-                    } else {
-                        ball->base.velocity[1] = -ball->base.velocity[1];
-                        float penetration = ball->radius - MFABS(collision.collisionPoint[1]);
-                        if (collision.direction == UP)
-                            ball->base.position[1] -= penetration;
-                        else
-                            ball->base.position[1] += penetration;
-                    }
-                }
+// Earliest brick the ball meets on its way. The batched kernel first drops candidates outside the
+// circle around the whole path, only the rest get the exact sweep.
+static bool sweepBricks(GameLevel* level, const mfloat_t* center, float radius, const mfloat_t* motion, Contact* contact, size_t* brick) {
+    mfloat_t end[VEC2_SIZE], min[VEC2_SIZE], max[VEC2_SIZE];
+    vec2_add(end, (mfloat_t*)center, (mfloat_t*)motion);
+    vec2_min(min, (mfloat_t*)center, end);
+    vec2_max(max, (mfloat_t*)center, end);
+    vec2_subtract_f(min, min, radius);
+    vec2_add_f(max, max, radius);
+    QueryLevelBricks(level, min, max, &candidates);
+    ClearBoxBatch(&candidateBoxes);
+    DYNAMIC_ARRAY_FOR_EACH(&candidates, size_t, index) {
+        mfloat_t position[VEC2_SIZE], size[VEC2_SIZE];
+        GetBrickRect(level, *index, position, size);
+        PushBox(&candidateBoxes, position, size);
+    }
+
+    mfloat_t middle[VEC2_SIZE];
+    vec2_add(middle, (mfloat_t*)center, vec2_multiply_f(middle, (mfloat_t*)motion, 0.5f));
+    float reach = radius + vec2_length((mfloat_t*)motion) / 2.0f;
+    const size_t* indices = (const size_t*)candidates.array;
+    bool found = false;
+    for (size_t first = 0; first < candidateBoxes.count; first += COLLISION_BATCH) {
+        size_t count = candidateBoxes.count - first < COLLISION_BATCH ? candidateBoxes.count - first : COLLISION_BATCH;
+        uint32_t nearby = CollideCircleBoxes(middle, reach, &candidateBoxes, first, count, NULL);
+        while (nearby) {
+            size_t index = indices[first + __builtin_ctz(nearby)];
+            nearby &= nearby - 1;
+            mfloat_t position[VEC2_SIZE], size[VEC2_SIZE];
+            GetBrickRect(level, index, position, size);
+            Contact candidate;
+            // ties go to the first brick in row-major order
+            if (SweepCircleBox(center, radius, motion, position, size, &candidate) && (!found || candidate.time < contact->time)) {
+                *contact = candidate;
+                *brick = index;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+static void bounceOffPaddle(BallObject* ball) {
+    float centerBoard = player->position[0] + player->size[0] / 2.0f;
+    float distance = (ball->base.position[0] + ball->radius) - centerBoard;
+    float percentage = distance / (player->size[0] / 2.0f);
+
+    float strength = 2.0f;
+    mfloat_t oldVelocity[VEC2_SIZE];
+    vec2_assign(oldVelocity, ball->base.velocity);
+    ball->base.velocity[0] = INITIAL_BALL_VELOCITY[0] * percentage * strength;
+    vec2_multiply_f(ball->base.velocity, vec2_normalize(ball->base.velocity, ball->base.velocity), vec2_length(oldVelocity));
+    ball->base.velocity[1] = -1.0f * MFABS(ball->base.velocity[1]);
+
+    ball->stuck = ball->sticky;
+    contactSounds |= SOUND_PADDLE;
+}
+
+// Moves the ball through one tick along its path. Walls, bricks and the paddle are swept for the
+// earliest contact, the ball is stopped there, bounces and travels the rest of the tick from it, so
+// contacts resolve in time order however far the ball gets in one tick.
+static void sweepBall(Game* game, GameLevel* level, BallObject* ball, float dt) {
+    float remaining = 1.0f;
+    for (unsigned int i = 0; i < MAX_BALL_CONTACTS && !ball->stuck; ++i) {
+        mfloat_t center[VEC2_SIZE], motion[VEC2_SIZE];
+        vec2_add_f(center, ball->base.position, ball->radius);
+        vec2_multiply_f(motion, ball->base.velocity, dt * remaining);
+
+        BallContact kind = BALL_CONTACT_NONE;
+        Contact contact, candidate;
+        size_t brick = 0;
+        if (sweepWalls(center, ball->radius, motion, game->width, &candidate)) {
+            contact = candidate;
+            kind = BALL_CONTACT_WALL;
+        }
+        if (sweepBricks(level, center, ball->radius, motion, &candidate, &brick) && (kind == BALL_CONTACT_NONE || candidate.time < contact.time)) {
+            contact = candidate;
+            kind = BALL_CONTACT_BRICK;
+        }
+        if (SweepCircleBox(center, ball->radius, motion, player->position, player->size, &candidate) && (kind == BALL_CONTACT_NONE || candidate.time < contact.time)) {
+            contact = candidate;
+            kind = BALL_CONTACT_PADDLE;
+        }
+        if (kind == BALL_CONTACT_NONE) {
+            vec2_add(ball->base.position, ball->base.position, motion);
+            return;
+        }
+
+        // stop just short of the contact, the next sweep starts outside what was hit
+        mfloat_t skin[VEC2_SIZE];
+        vec2_add(ball->base.position, ball->base.position, vec2_multiply_f(motion, motion, contact.time));
+        vec2_add(ball->base.position, ball->base.position, vec2_multiply_f(skin, contact.normal, CONTACT_SKIN));
+        remaining *= 1.0f - contact.time;
+
+        bool reflect = true;
+        if (kind == BALL_CONTACT_BRICK) {
+            mfloat_t position[VEC2_SIZE], size[VEC2_SIZE];
+            GetBrickRect(level, brick, position, size);
+            bool solid = IsBrickSolid(level, brick);
+            if (!solid) {
+                DestroyBrick(level, brick);
+                SpawnPowerUps(game, position);
+                contactSounds |= SOUND_BRICK;
+            } else {
+                shakeTime = 0.05f;
+                shake = true;
+                contactSounds |= SOUND_SOLID;
             }
+            reflect = !(ball->passthrough && !solid);
+        } else if (kind == BALL_CONTACT_PADDLE) {
+            bounceOffPaddle(ball);
+            reflect = false;
+        }
+        if (reflect) {
+            float along = vec2_dot(ball->base.velocity, contact.normal);
+            ball->base.velocity[0] -= 2.0f * along * contact.normal[0];
+            ball->base.velocity[1] -= 2.0f * along * contact.normal[1];
         }
     }
+}
+
+void DoCollisions(Game* game, float dt) {
+    BeginSimPhase(SIM_PHASE_BALLS);
+    GameLevel* level = ((GameLevel**)(game->levels.array))[game->level];
+    DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+        if (!ball->stuck)
+            sweepBall(game, level, ball, dt);
+    }
+    EndSimPhase();
+    if (contactSounds & SOUND_BRICK)
+        ma_engine_play_sound(&engine, "audio/bleep.mp3", NULL);
+    if (contactSounds & SOUND_SOLID)
+        ma_engine_play_sound(&engine, "audio/solid.wav", NULL);
+    if (contactSounds & SOUND_PADDLE)
+        ma_engine_play_sound(&engine, "audio/bleep.wav", NULL);
+    contactSounds = 0;
     DYNAMIC_ARRAY_FOR_EACH_PTR(&game->powerups, PowerUp, powerUp) {
         if (!(*powerUp)->base.destroyed) {
             if ((*powerUp)->base.position[1] >= game->height)
@@ -395,22 +745,6 @@ void DoCollisions(Game* game) {
             }
         }
     }
-    Collision result = CheckCollisionBall(ball, player);
-    if (!ball->stuck && result.hasCollision) {
-        float centerBoard = player->position[0] + player->size[0] / 2.0f;
-        float distance = (ball->base.position[0] + ball->radius) - centerBoard;
-        float percentage = distance / (player->size[0] / 2.0f);
-
-        float strength = 2.0f;
-        mfloat_t oldVelocity[VEC2_SIZE];
-        vec2_assign(oldVelocity, ball->base.velocity);
-        ball->base.velocity[0] = INITIAL_BALL_VELOCITY[0] * percentage * strength;
-        vec2_multiply_f(ball->base.velocity, vec2_normalize(ball->base.velocity, ball->base.velocity), vec2_length(oldVelocity));
-        ball->base.velocity[1] = -1.0f * MFABS(ball->base.velocity[1]);
-
-        ball->stuck = ball->sticky;
-        ma_engine_play_sound(&engine, "audio/bleep.wav", NULL);
-    }
 }
 
 void ResetLevel(Game* game) {
@@ -430,14 +764,11 @@ void ResetPlayer(Game* game) {
     // reset player/ball stats
     vec2_assign(player->size, (mfloat_t*)PLAYER_SIZE);
     vec2_assign(player->position, (mfloat_t[]){game->width / 2.0f - PLAYER_SIZE[0] / 2.0f, game->height - PLAYER_SIZE[1]});
-    mfloat_t ballPos[VEC2_SIZE];
-    vec2_add(ballPos, player->position, (mfloat_t[]){PLAYER_SIZE[0] / 2.0f - BALL_RADIUS, -(BALL_RADIUS * 2.0f)});
-    ResetBall(ball, ballPos, (mfloat_t*)INITIAL_BALL_VELOCITY);
+    SaveGameObjectState(player);
+    spawnBalls(game);
     // also disable all active powerups
-    effects->chaos = effects->confuse = false;
-    ball->passthrough = ball->sticky = false;
+    chaos = confuse = false;
     SET_ARRAY_VAL(player->color, VEC3_SIZE, 1.0f);
-    SET_ARRAY_VAL(ball->base.color, VEC3_SIZE, 1.0f);
 }
 
 void UpdatePowerUps(Game* game, float dt) {
@@ -453,21 +784,25 @@ void UpdatePowerUps(Game* game, float dt) {
 
                 if (strcmp(powerup->type, "sticky") == 0) {
                     if (!isOtherPowerUpActive(&game->powerups, "sticky")) {
-                        ball->sticky = false;
+                        DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+                            ball->sticky = false;
+                        }
                         SET_ARRAY_VAL(player->color, VEC3_SIZE, 1.0f);
                     }
                 } else if (strcmp(powerup->type, "pass-through") == 0) {
                     if (!isOtherPowerUpActive(&game->powerups, "pass-through")) {
-                        ball->passthrough = false;
-                        SET_ARRAY_VAL(ball->base.color, VEC3_SIZE, 1.0f);
+                        DYNAMIC_ARRAY_FOR_EACH(&balls, BallObject, ball) {
+                            ball->passthrough = false;
+                            SET_ARRAY_VAL(ball->base.color, VEC3_SIZE, 1.0f);
+                        }
                     }
                 } else if (strcmp(powerup->type, "confuse") == 0) {
                     if (!isOtherPowerUpActive(&game->powerups, "confuse")) {
-                        effects->confuse = false;
+                        confuse = false;
                     }
                 } else if (strcmp(powerup->type, "chaos") == 0) {
                     if (!isOtherPowerUpActive(&game->powerups, "chaos")) {
-                        effects->chaos = false;
+                        chaos = false;
                     }
                 }
             }
@@ -480,35 +815,58 @@ void UpdatePowerUps(Game* game, float dt) {
     }
 }
 
-void SpawnPowerUps(Game* game, GameObject* block) {
+void SpawnPowerUps(Game* game, mfloat_t* position) {
     if (ShouldSpawn(15)) {
-        pushPtr(&game->powerups, NewPowerUp("speed", (mfloat_t[VEC3_SIZE]){0.5f, 0.5f, 0.5f}, 0.0f, block->position, GetTexture("powerup_speed")));
+        pushPtr(&game->powerups, NewPowerUp("speed", (mfloat_t[VEC3_SIZE]){0.5f, 0.5f, 0.5f}, 0.0f, position, GetTexture("powerup_speed")));
     } else if (ShouldSpawn(15)) {
-        pushPtr(&game->powerups, NewPowerUp("sticky", (mfloat_t[VEC3_SIZE]){1.0f, 0.5f, 1.0f}, 20.0f, block->position, GetTexture("powerup_sticky")));
+        pushPtr(&game->powerups, NewPowerUp("sticky", (mfloat_t[VEC3_SIZE]){1.0f, 0.5f, 1.0f}, 20.0f, position, GetTexture("powerup_sticky")));
     } else if (ShouldSpawn(15)) {
-        pushPtr(&game->powerups, NewPowerUp("pass-through", (mfloat_t[VEC3_SIZE]){0.5f, 1.0f, 0.5f}, 10.0f, block->position, GetTexture("powerup_passthrough")));
+        pushPtr(&game->powerups, NewPowerUp("pass-through", (mfloat_t[VEC3_SIZE]){0.5f, 1.0f, 0.5f}, 10.0f, position, GetTexture("powerup_passthrough")));
     } else if (ShouldSpawn(15)) {
-        pushPtr(&game->powerups, NewPowerUp("pad-size-increase", (mfloat_t[VEC3_SIZE]){1.0f, 0.6f, 0.4f}, 0.0f, block->position, GetTexture("powerup_increase")));
+        pushPtr(&game->powerups, NewPowerUp("pad-size-increase", (mfloat_t[VEC3_SIZE]){1.0f, 0.6f, 0.4f}, 0.0f, position, GetTexture("powerup_increase")));
     } else if (ShouldSpawn(10)) {
-        pushPtr(&game->powerups, NewPowerUp("confuse", (mfloat_t[VEC3_SIZE]){1.0f, 0.3f, 0.3f}, 15.0f, block->position, GetTexture("powerup_confuse")));
+        pushPtr(&game->powerups, NewPowerUp("confuse", (mfloat_t[VEC3_SIZE]){1.0f, 0.3f, 0.3f}, 15.0f, position, GetTexture("powerup_confuse")));
     } else if (ShouldSpawn(10)) {
-        pushPtr(&game->powerups, NewPowerUp("chaos", (mfloat_t[VEC3_SIZE]){0.9f, 0.25f, 0.25f}, 15.0f, block->position, GetTexture("powerup_chaos")));
+        pushPtr(&game->powerups, NewPowerUp("chaos", (mfloat_t[VEC3_SIZE]){0.9f, 0.25f, 0.25f}, 15.0f, position, GetTexture("powerup_chaos")));
+    } else if (ShouldSpawn(15)) {
+        pushPtr(&game->powerups, NewPowerUp("multi-ball", (mfloat_t[VEC3_SIZE]){0.4f, 0.7f, 1.0f}, 0.0f, position, GetTexture("powerup_multiball")));
     }
 }
 
+// Only records the request, the renderer rebuilds its framebuffers when the snapshot carrying it arrives
+void SetGameSamples(Game* game, unsigned int samples) {
+    game->samples = samples;
+}
+
+// Called by the thread owning the context when the window's framebuffer changes size
+void SetGameViewport(Game* game __attribute__((unused)), int width, int height) {
+    SetPostProcessViewport(effects, width, height);
+}
+
+// Copies the last rendered frame, width * height bottom-up RGBA pixels
+void ReadGameFrame(Game* game __attribute__((unused)), unsigned char* pixels) {
+    ReadPostProcessOutput(effects, pixels);
+}
+
 void DetroyGame() {
+    if (queue) {
+        DestroyRenderQueue(queue);
+    }
     if (renderer) {
         DestroySpriteRenderer(renderer);
     }
     if (player) {
         CleanupGameObject(player);
     }
-    if (ball) {
-        CleanupBallObject(ball);
-    }
+    cleanup(&balls, NULL);
     if (effects) {
         CleanupPostProcess(effects);
     }
+    CleanupLevelSprites(&levelSprites);
+    cleanup(&candidates, NULL);
+    CleanupBoxBatch(&candidateBoxes);
+    CleanupSnapshotBuffer(&snapshots);
+    frame = NULL;
     ma_sound_uninit(&backgroundMusic);
     ma_engine_uninit(&engine);
 }
@@ -6,53 +6,64 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "game_object.h"
+#include "job_pool.h"
+#include "mathc.h"
 #include "resource_manager.h"
 #include "util.h"
 
+// Brick colors, indexed by BrickCell.palette
+static const mfloat_t palette[][VEC3_SIZE] = {
+    {0.8f, 0.8f, 0.7f},  // solid
+    {0.2f, 0.6f, 1.0f},
+    {0.0f, 0.7f, 0.0f},
+    {0.8f, 0.8f, 0.4f},
+    {1.0f, 0.5f, 0.0f},
+    {1.0f, 1.0f, 1.0f},
+};
+#define PALETTE_SIZE (sizeof(palette) / sizeof(palette[0]))
+
+static void setBit(DynamicArray* bits, size_t index) {
+    ((uint64_t*)bits->array)[index / 64] |= UINT64_C(1) << (index % 64);
+}
+
+static bool testBit(const DynamicArray* bits, size_t index) {
+    return (((const uint64_t*)bits->array)[index / 64] >> (index % 64)) & 1;
+}
+
+// Words for count bits, all clear
+static void clearBits(DynamicArray* bits, size_t count) {
+    clearArray(bits, NULL);
+    uint64_t word = 0;
+    for (size_t i = 0; i < count; i += 64)
+        push(bits, &word);
+}
+
 static void init(GameLevel* level, DynamicArray* tileData, unsigned int levelWidth, unsigned int levelHeight) {
     DynamicArray** rows = (DynamicArray**)(tileData->array);
     unsigned int height = tileData->size;
     unsigned int width = rows[0]->size;
     float unit_width = levelWidth / (float)width, unit_height = levelHeight / (float)height;
+    level->columns = width;
+    level->rows = height;
+    level->cellWidth = unit_width;
+    level->cellHeight = unit_height;
+    clearBits(&level->standing, (size_t)width * height);
+    clearBits(&level->solid, (size_t)width * height);
 
     for (size_t y = 0; y < height; ++y) {
         DynamicArray* yData = rows[y];
         for (size_t x = 0; x < width; ++x) {
-            unsigned int yxData = ((unsigned int*)yData->array)[x];
-
+            unsigned int yxData = x < yData->size ? ((unsigned int*)yData->array)[x] : 0;
+            size_t index = level->cells.size;
+            BrickCell cell = {.tile = yxData > UINT8_MAX ? UINT8_MAX : (uint8_t)yxData, .palette = 0};
             if (yxData == 1) {
-                GameObject* obj = NewGameObject(
-                    (mfloat_t[]){unit_width * x, unit_height * y},
-                    (mfloat_t[]){unit_width, unit_height},
-                    GetTexture("block_solid"),
-                    (mfloat_t[]){0.8f, 0.8f, 0.7f},
-                    NULL);
-
-                obj->isSolid = true;
-                pushPtr(&level->bricks, obj);
+                setBit(&level->solid, index);
             } else if (yxData > 1) {
-                mfloat_t* color = (mfloat_t[]){1.0f, 1.0f, 1.0f};
-                if (yxData == 2)
-                    color = (mfloat_t[]){0.2f, 0.6f, 1.0f};
-                if (yxData == 3)
-                    color = (mfloat_t[]){0.0f, 0.7f, 0.0f};
-                if (yxData == 4)
-                    color = (mfloat_t[]){0.8f, 0.8f, 0.4f};
-                if (yxData == 5)
-                    color = (mfloat_t[]){1.0f, 0.5f, 0.0f};
-
-                pushPtr(
-                    &level->bricks,
-                    NewGameObject(
-                        (mfloat_t[]){unit_width * x, unit_height * y},
-                        (mfloat_t[]){unit_width, unit_height},
-                        GetTexture("block"),
-                        color,
-                        NULL  // #
-                        )     // #
-                );
+                cell.palette = yxData < PALETTE_SIZE ? yxData - 1 : PALETTE_SIZE - 1;
             }
+            if (yxData > 0)
+                setBit(&level->standing, index);
+            push(&level->cells, &cell);
         }
     }
 }
@@ -64,8 +75,17 @@ static void processLine(const char* line, void* context) {
     DynamicArray* innerTileArray = malloc(sizeof(DynamicArray));
     initialize(innerTileArray, 50, sizeof(unsigned int));
 
-    char* token = strtok(lineCopy, " ");
-    while (token != NULL) {
+    // split on spaces by hand, strtok keeps hidden state and levels are parsed on several threads at once
+    char* cursor = lineCopy;
+    for (;;) {
+        cursor += strspn(cursor, " ");
+        if (*cursor == '\0')
+            break;
+        char* token = cursor;
+        cursor += strcspn(cursor, " ");
+        if (*cursor != '\0')
+            *cursor++ = '\0';
+
         char* endptr;
         errno = 0;
         unsigned long value = strtoul(token, &endptr, 10);
@@ -78,19 +98,12 @@ static void processLine(const char* line, void* context) {
             unsigned int parsedValue = (unsigned int)value;
             push(innerTileArray, &parsedValue);
         }
-
-        token = strtok(NULL, " ");
     }
     pushPtr(outerTileArray, innerTileArray);
 
     free(lineCopy);
 }
 
-static void clearArrayCallback(void* obj) {
-    GameObject* gameObj = *(GameObject**)obj;
-    CleanupGameObject(gameObj);
-}
-
 static void cleanupOuterArrayCallback(void* item) {
     DynamicArray* innerArray = *(DynamicArray**)item;
     cleanup(innerArray, NULL);
@@ -99,32 +112,245 @@ static void cleanupOuterArrayCallback(void* item) {
 
 GameLevel* NewGameLevel() {
     GameLevel* level = malloc(sizeof(GameLevel));
-    initialize(&level->bricks, 256, sizeof(GameObject*));
+    initialize(&level->cells, 256, sizeof(BrickCell));
+    initialize(&level->standing, 4, sizeof(uint64_t));
+    initialize(&level->solid, 4, sizeof(uint64_t));
+    level->columns = level->rows = 0;
+    level->origin[0] = level->origin[1] = 0.0f;
+    level->cellWidth = level->cellHeight = 0.0f;
+    level->generation = 0;
     return level;
 }
 
-void LoadLevel(GameLevel* level, const char* file, unsigned int levelWidth, unsigned int levelHeight) {
-    clearArray(&level->bricks, clearArrayCallback);
-    DynamicArray outerTileArray;
-    initialize(&outerTileArray, 50, sizeof(DynamicArray*));
-    readAndProcessLine(file, processLine, &outerTileArray);
-    if (outerTileArray.size > 0) {
-        init(level, &outerTileArray, levelWidth, levelHeight);
+// Tile rows parsed from a level file, turned into bricks once the textures they use are loaded
+typedef struct {
+    GameLevel* level;
+    const char* file;
+    unsigned int levelWidth, levelHeight;
+    DynamicArray tiles;
+} LevelLoad;
+
+static void parseLevel(void* data) {
+    LevelLoad* load = (LevelLoad*)data;
+    readAndProcessLine(load->file, processLine, &load->tiles);
+}
+
+static void buildLevel(void* data) {
+    LevelLoad* load = (LevelLoad*)data;
+    GameLevel* level = load->level;
+    clearArray(&level->cells, NULL);
+    clearArray(&level->standing, NULL);
+    clearArray(&level->solid, NULL);
+    level->columns = level->rows = 0;
+    if (load->tiles.size > 0) {
+        init(level, &load->tiles, load->levelWidth, load->levelHeight);
     }
-    cleanup(&outerTileArray, cleanupOuterArrayCallback);
+    cleanup(&load->tiles, cleanupOuterArrayCallback);
+    free(load);
+
+    ++level->generation;
+}
+
+static LevelLoad* newLevelLoad(GameLevel* level, const char* file, unsigned int levelWidth, unsigned int levelHeight) {
+    LevelLoad* load = malloc(sizeof(LevelLoad));
+    load->level = level;
+    load->file = file;
+    load->levelWidth = levelWidth;
+    load->levelHeight = levelHeight;
+    initialize(&load->tiles, 50, sizeof(DynamicArray*));
+    return load;
+}
+
+void LoadLevel(GameLevel* level, const char* file, unsigned int levelWidth, unsigned int levelHeight) {
+    LevelLoad* load = newLevelLoad(level, file, levelWidth, levelHeight);
+    parseLevel(load);
+    buildLevel(load);
+}
+
+// Parses on a worker and builds the bricks in FinishJobs, after textures submitted before it are loaded
+void LoadLevelAsync(GameLevel* level, const char* file, unsigned int levelWidth, unsigned int levelHeight) {
+    SubmitJob(parseLevel, buildLevel, newLevelLoad(level, file, levelWidth, levelHeight));
 }
 
-void DrawLevel(GameLevel* level, SpriteRenderer* renderer) {
-    DYNAMIC_ARRAY_FOR_EACH_PTR(&level->bricks, GameObject, tile) {
-        if (!(*tile)->destroyed)
-            DrawGameObject(*tile, renderer);
+// Rectangle of the brick in tile index, derived from the grid
+void GetBrickRect(const GameLevel* level, size_t index, mfloat_t* position, mfloat_t* size) {
+    size_t column = index % level->columns, row = index / level->columns;
+    position[0] = level->origin[0] + level->cellWidth * column;
+    position[1] = level->origin[1] + level->cellHeight * row;
+    size[0] = level->cellWidth;
+    size[1] = level->cellHeight;
+}
+
+bool IsBrickSolid(const GameLevel* level, size_t index) {
+    return testBit(&level->solid, index);
+}
+
+void DestroyBrick(GameLevel* level, size_t index) {
+    ((uint64_t*)level->standing.array)[index / 64] &= ~(UINT64_C(1) << (index % 64));
+}
+
+static size_t clampCell(float coordinate, float cellSize, unsigned int count) {
+    if (coordinate <= 0.0f)
+        return 0;
+    size_t cell = (size_t)(coordinate / cellSize);
+    return cell < count ? cell : count - 1;
+}
+
+// Replaces indices with the standing bricks whose tiles overlap the rectangle from min to max, in
+// brick order. The work depends on the rectangle's size only, not on how many bricks the level has.
+void QueryLevelBricks(const GameLevel* level, const mfloat_t* min, const mfloat_t* max, DynamicArray* indices) {
+    clearArray(indices, NULL);
+    if (level->columns == 0 || level->rows == 0)
+        return;
+    float left = min[0] - level->origin[0], top = min[1] - level->origin[1];
+    float right = max[0] - level->origin[0], bottom = max[1] - level->origin[1];
+    float width = level->columns * level->cellWidth, height = level->rows * level->cellHeight;
+    if (right < 0.0f || bottom < 0.0f || left >= width || top >= height)
+        return;
+    size_t firstColumn = clampCell(left, level->cellWidth, level->columns);
+    size_t lastColumn = clampCell(right, level->cellWidth, level->columns);
+    size_t firstRow = clampCell(top, level->cellHeight, level->rows);
+    size_t lastRow = clampCell(bottom, level->cellHeight, level->rows);
+    for (size_t row = firstRow; row <= lastRow; ++row) {
+        for (size_t column = firstColumn; column <= lastColumn; ++column) {
+            size_t index = row * level->columns + column;
+            if (testBit(&level->standing, index))
+                push(indices, &index);
+        }
     }
 }
 
+// Breakable bricks left standing, a popcount over the bitsets
+size_t CountBreakableBricks(const GameLevel* level) {
+    const uint64_t* standing = (const uint64_t*)level->standing.array;
+    const uint64_t* solid = (const uint64_t*)level->solid.array;
+    size_t count = 0;
+    for (size_t w = 0; w < level->standing.size; ++w)
+        count += __builtin_popcountll(standing[w] & ~solid[w]);
+    return count;
+}
+
 bool IsLevelCompleted(GameLevel* level) {
-    DYNAMIC_ARRAY_FOR_EACH_PTR(&level->bricks, GameObject, tile) {
-        if (!(*tile)->isSolid && !(*tile)->destroyed)
-            return false;
+    return CountBreakableBricks(level) == 0;
+}
+
+void InitLevelSnapshot(LevelSnapshot* snapshot) {
+    snapshot->source = NULL;
+    snapshot->generation = 0;
+    initialize(&snapshot->bricks, 256, sizeof(SpriteCommand));
+    initialize(&snapshot->tiles, 256, sizeof(uint32_t));
+    initialize(&snapshot->standing, 4, sizeof(uint64_t));
+}
+
+void SnapshotLevel(GameLevel* level, LevelSnapshot* snapshot) {
+    if (snapshot->source != level || snapshot->generation != level->generation) {
+        clearArray(&snapshot->bricks, NULL);
+        clearArray(&snapshot->tiles, NULL);
+        Texture2D* block = GetTexture("block");
+        Texture2D* blockSolid = GetTexture("block_solid");
+        const BrickCell* cells = (const BrickCell*)level->cells.array;
+        for (uint32_t i = 0; i < level->cells.size; ++i) {
+            if (cells[i].tile == 0)
+                continue;
+            mfloat_t position[VEC2_SIZE], size[VEC2_SIZE];
+            GetBrickRect(level, i, position, size);
+            SpriteCommand command = MakeSpriteCommand(IsBrickSolid(level, i) ? blockSolid : block, position, size, 0.0f, (mfloat_t*)palette[cells[i].palette]);
+            push(&snapshot->bricks, &command);
+            push(&snapshot->tiles, &i);
+        }
+        snapshot->source = level;
+        snapshot->generation = level->generation;
+    }
+    clearArray(&snapshot->standing, NULL);
+    DYNAMIC_ARRAY_FOR_EACH(&level->standing, uint64_t, word) {
+        push(&snapshot->standing, word);
+    }
+}
+
+void CleanupLevelSnapshot(LevelSnapshot* snapshot) {
+    cleanup(&snapshot->bricks, NULL);
+    cleanup(&snapshot->tiles, NULL);
+    cleanup(&snapshot->standing, NULL);
+}
+
+void InitLevelSprites(LevelSprites* sprites) {
+    sprites->sprites = NULL;
+    sprites->renderer = NULL;
+    sprites->source = NULL;
+    sprites->generation = 0;
+    initialize(&sprites->standing, 4, sizeof(uint64_t));
+    initialize(&sprites->spriteOfTile, 256, sizeof(uint32_t));
+}
+
+static void rebuildSprites(LevelSprites* sprites, const LevelSnapshot* snapshot, SpriteRenderer* renderer) {
+    if (sprites->sprites)
+        DeleteStaticSprites(sprites->sprites);
+    // NewStaticSprites sorts the commands it is given, so hand it a scratch copy
+    size_t count = snapshot->bricks.size;
+    SpriteCommand* commands = malloc((count > 0 ? count : 1) * sizeof(SpriteCommand));
+    memcpy(commands, snapshot->bricks.array, count * sizeof(SpriteCommand));
+    sprites->sprites = NewStaticSprites(renderer, commands, count);
+    free(commands);
+
+    // every brick starts out visible, the diff against the snapshot hides the destroyed ones
+    size_t tiles = snapshot->standing.size * 64;
+    clearBits(&sprites->standing, tiles);
+    clearArray(&sprites->spriteOfTile, NULL);
+    uint32_t none = UINT32_MAX;
+    for (size_t i = 0; i < tiles; ++i)
+        push(&sprites->spriteOfTile, &none);
+    const uint32_t* tileOfSprite = (const uint32_t*)snapshot->tiles.array;
+    for (uint32_t i = 0; i < count; ++i) {
+        setBit(&sprites->standing, tileOfSprite[i]);
+        ((uint32_t*)sprites->spriteOfTile.array)[tileOfSprite[i]] = i;
+    }
+    sprites->source = snapshot->source;
+    sprites->generation = snapshot->generation;
+}
+
+// Brings the GPU copy up to date with the snapshot, returns whether anything it draws changed
+bool SyncLevelSprites(LevelSprites* sprites, const LevelSnapshot* snapshot, SpriteRenderer* renderer) {
+    bool changed = false;
+    if (!sprites->sprites || sprites->source != snapshot->source || sprites->generation != snapshot->generation) {
+        rebuildSprites(sprites, snapshot, renderer);
+        changed = true;
     }
-    return true;
+
+    // only words that differ from what the GPU holds are walked bit by bit
+    uint64_t* current = (uint64_t*)sprites->standing.array;
+    const uint64_t* target = (const uint64_t*)snapshot->standing.array;
+    for (size_t w = 0; w < sprites->standing.size && w < snapshot->standing.size; ++w) {
+        uint64_t flipped = current[w] ^ target[w];
+        if (flipped)
+            changed = true;
+        while (flipped) {
+            unsigned int bit = __builtin_ctzll(flipped);
+            uint32_t sprite = ((const uint32_t*)sprites->spriteOfTile.array)[w * 64 + bit];
+            SetStaticSpriteVisible(sprites->sprites, sprite, (target[w] >> bit) & 1);
+            flipped &= flipped - 1;
+        }
+        current[w] = target[w];
+    }
+    return changed;
+}
+
+static unsigned int drawLevel(void* data) {
+    LevelSprites* sprites = (LevelSprites*)data;
+    return DrawStaticSprites(sprites->renderer, sprites->sprites);
+}
+
+// The bricks go into the queue as one item, their static buffer is drawn a texture run at a time
+void DrawLevel(LevelSprites* sprites, RenderQueue* queue) {
+    if (!sprites->sprites)
+        return;
+    sprites->renderer = queue->sprites;
+    SubmitRenderItem(queue, RENDER_LAYER_LEVEL, BLEND_ALPHA, queue->sprites->shader, NULL, drawLevel, sprites);
+}
+
+void CleanupLevelSprites(LevelSprites* sprites) {
+    if (sprites->sprites)
+        DeleteStaticSprites(sprites->sprites);
+    cleanup(&sprites->standing, NULL);
+    cleanup(&sprites->spriteOfTile, NULL);
+    sprites->sprites = NULL;
 }
@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 
+#include "mathc.h"
 #include "sprite_renderer.h"
 
 GameObject* NewGameObject(mfloat_t* pos, mfloat_t* size, Texture2D* sprite, mfloat_t* color, mfloat_t* velocity) {
@@ -9,6 +10,8 @@ GameObject* NewGameObject(mfloat_t* pos, mfloat_t* size, Texture2D* sprite, mflo
 
     gameObj->position[0] = pos[0];
     gameObj->position[1] = pos[1];
+    gameObj->previousPosition[0] = pos[0];
+    gameObj->previousPosition[1] = pos[1];
 
     gameObj->size[0] = size[0];
     gameObj->size[1] = size[1];
@@ -39,8 +42,24 @@ GameObject* NewGameObject(mfloat_t* pos, mfloat_t* size, Texture2D* sprite, mflo
     return gameObj;
 }
 
-void DrawGameObject(GameObject* gameObj, SpriteRenderer* renderer) {
-    DrawSprite(renderer, gameObj->sprite, gameObj->position, gameObj->size, gameObj->rotation, gameObj->color);
+void SaveGameObjectState(GameObject* gameObj) {
+    vec2_assign(gameObj->previousPosition, gameObj->position);
+}
+
+void CaptureGameObject(GameObject* gameObj, GameObjectState* state) {
+    state->sprite = gameObj->sprite;
+    vec2_assign(state->previousPosition, gameObj->previousPosition);
+    vec2_assign(state->position, gameObj->position);
+    vec2_assign(state->size, gameObj->size);
+    vec3_assign(state->color, gameObj->color);
+    state->rotation = gameObj->rotation;
+}
+
+// Drawn between the last two simulation ticks, alpha 0 is the previous tick and 1 the current one
+void DrawGameObject(const GameObjectState* state, RenderQueue* queue, RenderLayer layer, float alpha) {
+    mfloat_t position[VEC2_SIZE];
+    vec2_lerp(position, (mfloat_t*)state->previousPosition, (mfloat_t*)state->position, alpha);
+    SubmitSpriteItem(queue, layer, state->sprite, position, (mfloat_t*)state->size, state->rotation, (mfloat_t*)state->color);
 }
 
 void CleanupGameObject(GameObject* gameObj) {
@@ -0,0 +1,57 @@
+#include "game_snapshot.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "game_level.h"
+#include "game_object.h"
+#include "particle_generator.h"
+#include "util.h"
+
+#define SNAPSHOT_FRESH 4u
+#define SNAPSHOT_INDEX 3u
+
+void InitSnapshotBuffer(SnapshotBuffer* buffer) {
+    for (size_t i = 0; i < SNAPSHOT_SLOTS; ++i) {
+        GameSnapshot* snapshot = &buffer->slots[i];
+        snapshot->valid = false;
+        InitLevelSnapshot(&snapshot->level);
+        initialize(&snapshot->balls, 16, sizeof(GameObjectState));
+        initialize(&snapshot->powerups, 16, sizeof(GameObjectState));
+        initialize(&snapshot->particles, 512, sizeof(ParticleState));
+    }
+    atomic_init(&buffer->latest, 0u);
+    buffer->writing = 1;
+    buffer->reading = 2;
+}
+
+GameSnapshot* BeginSnapshotWrite(SnapshotBuffer* buffer) {
+    return &buffer->slots[buffer->writing];
+}
+
+void PublishSnapshot(SnapshotBuffer* buffer) {
+    buffer->slots[buffer->writing].valid = true;
+    // release makes the filled slot visible to the reader, acquire hands back a slot it is done with
+    unsigned int previous = atomic_exchange_explicit(&buffer->latest, buffer->writing | SNAPSHOT_FRESH, memory_order_acq_rel);
+    buffer->writing = previous & SNAPSHOT_INDEX;
+}
+
+// The newest published snapshot, or the one already held when nothing new arrived. NULL before the first publish.
+const GameSnapshot* AcquireSnapshot(SnapshotBuffer* buffer) {
+    if (atomic_load_explicit(&buffer->latest, memory_order_relaxed) & SNAPSHOT_FRESH) {
+        unsigned int previous = atomic_exchange_explicit(&buffer->latest, buffer->reading, memory_order_acq_rel);
+        buffer->reading = previous & SNAPSHOT_INDEX;
+    }
+    GameSnapshot* snapshot = &buffer->slots[buffer->reading];
+    return snapshot->valid ? snapshot : NULL;
+}
+
+void CleanupSnapshotBuffer(SnapshotBuffer* buffer) {
+    for (size_t i = 0; i < SNAPSHOT_SLOTS; ++i) {
+        GameSnapshot* snapshot = &buffer->slots[i];
+        CleanupLevelSnapshot(&snapshot->level);
+        cleanup(&snapshot->balls, NULL);
+        cleanup(&snapshot->powerups, NULL);
+        cleanup(&snapshot->particles, NULL);
+    }
+}
@@ -0,0 +1,192 @@
+#include "gl_state.h"
+
+#include <GL/glew.h>
+#include <stddef.h>
+
+// Value no GL object name can have, forces the next bind to be issued
+#define STATE_UNKNOWN 0xFFFFFFFFu
+
+static struct {
+    unsigned int program;
+    unsigned int activeUnit;
+    unsigned int textures[STATE_MAX_TEXTURE_UNITS];
+    unsigned int vertexArray;
+    unsigned int arrayBuffer;
+    unsigned int uniformBuffer;
+    unsigned int pixelUnpackBuffer;
+    unsigned int readFramebuffer, drawFramebuffer;
+    unsigned int blendSrc, blendDst;
+} cache;
+static bool isInitialized = false;
+static StateStats stats;
+
+static void ensureInitialized() {
+    if (!isInitialized)
+        ResetStateCache();
+}
+
+// Returns true when the change must reach the driver
+static bool track(StateKind kind, unsigned int* slot, unsigned int value) {
+    if (*slot == value) {
+        ++stats.elided[kind];
+        ++stats.totalElided;
+        return false;
+    }
+    *slot = value;
+    ++stats.issued[kind];
+    ++stats.totalIssued;
+    return true;
+}
+
+static unsigned int* bufferSlot(unsigned int target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return &cache.arrayBuffer;
+        case GL_UNIFORM_BUFFER:
+            return &cache.uniformBuffer;
+        case GL_PIXEL_UNPACK_BUFFER:
+            return &cache.pixelUnpackBuffer;
+        default:
+            return NULL;
+    }
+}
+
+void StateUseProgram(unsigned int program) {
+    ensureInitialized();
+    if (track(STATE_PROGRAM, &cache.program, program))
+        glUseProgram(program);
+}
+
+void StateActiveTexture(unsigned int unit) {
+    ensureInitialized();
+    if (track(STATE_ACTIVE_TEXTURE, &cache.activeUnit, unit - GL_TEXTURE0))
+        glActiveTexture(unit);
+}
+
+void StateBindTexture(unsigned int target, unsigned int texture) {
+    ensureInitialized();
+    if (target != GL_TEXTURE_2D || cache.activeUnit >= STATE_MAX_TEXTURE_UNITS) {
+        ++stats.issued[STATE_TEXTURE];
+        ++stats.totalIssued;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (track(STATE_TEXTURE, &cache.textures[cache.activeUnit], texture))
+        glBindTexture(target, texture);
+}
+
+void StateBindVertexArray(unsigned int vao) {
+    ensureInitialized();
+    if (track(STATE_VERTEX_ARRAY, &cache.vertexArray, vao))
+        glBindVertexArray(vao);
+}
+
+void StateBindBuffer(unsigned int target, unsigned int buffer) {
+    ensureInitialized();
+    unsigned int* slot = bufferSlot(target);
+    if (!slot) {
+        ++stats.issued[STATE_BUFFER];
+        ++stats.totalIssued;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (track(STATE_BUFFER, slot, buffer))
+        glBindBuffer(target, buffer);
+}
+
+void StateBindFramebuffer(unsigned int target, unsigned int framebuffer) {
+    ensureInitialized();
+    if (target == GL_READ_FRAMEBUFFER) {
+        if (track(STATE_FRAMEBUFFER, &cache.readFramebuffer, framebuffer))
+            glBindFramebuffer(target, framebuffer);
+    } else if (target == GL_DRAW_FRAMEBUFFER) {
+        if (track(STATE_FRAMEBUFFER, &cache.drawFramebuffer, framebuffer))
+            glBindFramebuffer(target, framebuffer);
+    } else {
+        bool changed = cache.readFramebuffer != framebuffer || cache.drawFramebuffer != framebuffer;
+        unsigned int previous = changed ? STATE_UNKNOWN : framebuffer;
+        if (track(STATE_FRAMEBUFFER, &previous, framebuffer)) {
+            cache.readFramebuffer = cache.drawFramebuffer = framebuffer;
+            glBindFramebuffer(target, framebuffer);
+        }
+    }
+}
+
+void StateBlendFunc(unsigned int sfactor, unsigned int dfactor) {
+    ensureInitialized();
+    bool changed = cache.blendSrc != sfactor || cache.blendDst != dfactor;
+    unsigned int previous = changed ? STATE_UNKNOWN : sfactor;
+    if (track(STATE_BLEND_FUNC, &previous, sfactor)) {
+        cache.blendSrc = sfactor;
+        cache.blendDst = dfactor;
+        glBlendFunc(sfactor, dfactor);
+    }
+}
+
+// Deleting a bound object reverts the binding to 0, names may then be reused by new objects
+void StateDeleteProgram(unsigned int program) {
+    ensureInitialized();
+    if (cache.program == program)
+        cache.program = STATE_UNKNOWN;
+    glDeleteProgram(program);
+}
+
+void StateDeleteTexture(unsigned int texture) {
+    ensureInitialized();
+    for (size_t i = 0; i < STATE_MAX_TEXTURE_UNITS; ++i) {
+        if (cache.textures[i] == texture)
+            cache.textures[i] = 0;
+    }
+    glDeleteTextures(1, &texture);
+}
+
+void StateDeleteVertexArray(unsigned int vao) {
+    ensureInitialized();
+    if (cache.vertexArray == vao)
+        cache.vertexArray = 0;
+    glDeleteVertexArrays(1, &vao);
+}
+
+void StateDeleteBuffer(unsigned int buffer) {
+    ensureInitialized();
+    if (cache.arrayBuffer == buffer)
+        cache.arrayBuffer = 0;
+    if (cache.uniformBuffer == buffer)
+        cache.uniformBuffer = 0;
+    if (cache.pixelUnpackBuffer == buffer)
+        cache.pixelUnpackBuffer = 0;
+    glDeleteBuffers(1, &buffer);
+}
+
+void StateDeleteFramebuffer(unsigned int framebuffer) {
+    ensureInitialized();
+    if (cache.readFramebuffer == framebuffer)
+        cache.readFramebuffer = 0;
+    if (cache.drawFramebuffer == framebuffer)
+        cache.drawFramebuffer = 0;
+    glDeleteFramebuffers(1, &framebuffer);
+}
+
+void ResetStateCache() {
+    cache.program = STATE_UNKNOWN;
+    cache.activeUnit = STATE_UNKNOWN;
+    for (size_t i = 0; i < STATE_MAX_TEXTURE_UNITS; ++i)
+        cache.textures[i] = STATE_UNKNOWN;
+    cache.vertexArray = STATE_UNKNOWN;
+    cache.arrayBuffer = STATE_UNKNOWN;
+    cache.uniformBuffer = STATE_UNKNOWN;
+    cache.pixelUnpackBuffer = STATE_UNKNOWN;
+    cache.readFramebuffer = STATE_UNKNOWN;
+    cache.drawFramebuffer = STATE_UNKNOWN;
+    cache.blendSrc = STATE_UNKNOWN;
+    cache.blendDst = STATE_UNKNOWN;
+    isInitialized = true;
+}
+
+void BeginStateFrame() {
+    stats = (StateStats){0};
+}
+
+StateStats GetStateStats() {
+    return stats;
+}
@@ -0,0 +1,144 @@
+#include "gpu_timer.h"
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <stdio.h>
+
+static const char* passNames[GPU_PASS_COUNT] = {"layer", "scene", "resolve", "post", "text"};
+
+static unsigned int queries[GPU_TIMER_FRAMES][GPU_PASS_COUNT];
+static bool issued[GPU_TIMER_FRAMES][GPU_PASS_COUNT];
+static unsigned int frame = 0;  // frames begun so far, selects the query set in use
+static bool isInitialized = false;
+static int activePass = -1;
+
+// Ring of per-frame results in milliseconds, oldest first starting at historyStart
+static float history[GPU_TIMER_HISTORY][GPU_PASS_COUNT];
+static unsigned int historyFrames[GPU_TIMER_HISTORY];
+static unsigned int historyStart = 0, historyCount = 0;
+static double sums[GPU_PASS_COUNT];
+
+static void recordFrame(unsigned int set, unsigned int frameNumber) {
+    unsigned int slot = (historyStart + historyCount) % GPU_TIMER_HISTORY;
+    if (historyCount == GPU_TIMER_HISTORY) {
+        for (size_t pass = 0; pass < GPU_PASS_COUNT; ++pass)
+            sums[pass] -= history[historyStart][pass];
+        historyStart = (historyStart + 1) % GPU_TIMER_HISTORY;
+    } else {
+        ++historyCount;
+    }
+
+    for (size_t pass = 0; pass < GPU_PASS_COUNT; ++pass) {
+        float milliseconds = 0.0f;
+        // a pass that was skipped this frame costs nothing
+        if (issued[set][pass]) {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[set][pass], GL_QUERY_RESULT, &nanoseconds);
+            milliseconds = nanoseconds / 1.0e6f;
+            issued[set][pass] = false;
+        }
+        history[slot][pass] = milliseconds;
+        sums[pass] += milliseconds;
+    }
+    historyFrames[slot] = frameNumber;
+}
+
+// Results of a set are normally ready by the time it comes around again. When the GPU is still
+// behind the frame is dropped instead of blocking on it.
+static bool resultsAvailable(unsigned int set) {
+    for (size_t pass = 0; pass < GPU_PASS_COUNT; ++pass) {
+        if (!issued[set][pass])
+            continue;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[set][pass], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    return true;
+}
+
+void BeginGpuFrame() {
+    if (!isInitialized) {
+        glGenQueries(GPU_TIMER_FRAMES * GPU_PASS_COUNT, &queries[0][0]);
+        isInitialized = true;
+    }
+
+    // the first frame pays for lazy driver work such as shader compilation and is left out
+    unsigned int set = frame % GPU_TIMER_FRAMES;
+    if (frame >= GPU_TIMER_FRAMES) {
+        if (frame > GPU_TIMER_FRAMES && resultsAvailable(set)) {
+            recordFrame(set, frame - GPU_TIMER_FRAMES);
+        } else {
+            for (size_t pass = 0; pass < GPU_PASS_COUNT; ++pass)
+                issued[set][pass] = false;
+        }
+    }
+    ++frame;
+}
+
+void BeginGpuPass(GpuPass pass) {
+    if (!isInitialized || activePass >= 0)
+        return;
+    unsigned int set = (frame - 1) % GPU_TIMER_FRAMES;
+    glBeginQuery(GL_TIME_ELAPSED, queries[set][pass]);
+    issued[set][pass] = true;
+    activePass = pass;
+}
+
+void EndGpuPass() {
+    if (activePass < 0)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    activePass = -1;
+}
+
+const char* GetGpuPassName(GpuPass pass) {
+    return passNames[pass];
+}
+
+float GetGpuPassTime(GpuPass pass) {
+    return historyCount > 0 ? (float)(sums[pass] / historyCount) : 0.0f;
+}
+
+float GetGpuFrameTime() {
+    float total = 0.0f;
+    for (size_t pass = 0; pass < GPU_PASS_COUNT; ++pass)
+        total += GetGpuPassTime(pass);
+    return total;
+}
+
+// One row per frame still in the rolling window, times in milliseconds
+bool WriteGpuTimingsCsv(const char* file) {
+    FILE* out = fopen(file, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Could not open %s for writing\n", file);
+        return false;
+    }
+    fprintf(out, "frame");
+    for (size_t pass = 0; pass < GPU_PASS_COUNT; ++pass)
+        fprintf(out, ",%s_ms", passNames[pass]);
+    fprintf(out, "\n");
+    for (unsigned int i = 0; i < historyCount; ++i) {
+        unsigned int slot = (historyStart + i) % GPU_TIMER_HISTORY;
+        fprintf(out, "%u", historyFrames[slot]);
+        for (size_t pass = 0; pass < GPU_PASS_COUNT; ++pass)
+            fprintf(out, ",%.4f", history[slot][pass]);
+        fprintf(out, "\n");
+    }
+    fclose(out);
+    return true;
+}
+
+void CleanupGpuTimers() {
+    if (isInitialized)
+        glDeleteQueries(GPU_TIMER_FRAMES * GPU_PASS_COUNT, &queries[0][0]);
+    isInitialized = false;
+    activePass = -1;
+    frame = 0;
+    historyStart = historyCount = 0;
+    for (size_t pass = 0; pass < GPU_PASS_COUNT; ++pass) {
+        sums[pass] = 0.0;
+        for (size_t set = 0; set < GPU_TIMER_FRAMES; ++set)
+            issued[set][pass] = false;
+    }
+}
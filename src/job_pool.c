@@ -0,0 +1,141 @@
+#include "job_pool.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "util.h"
+
+typedef struct {
+    JobFunction run;
+    JobFunction finish;
+    void* data;
+    bool done;
+} Job;
+
+static pthread_t workers[JOB_POOL_MAX_WORKERS];
+static unsigned int workerCount = 0;
+static bool isRunning = false, stopping = false;
+
+// Jobs are kept by index under the lock, the array may move when it grows
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobAvailable = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobDone = PTHREAD_COND_INITIALIZER;
+static DynamicArray jobs;
+static size_t nextRun = 0, nextFinish = 0;
+
+static unsigned int coreCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (unsigned int)cores : 1;
+#endif
+}
+
+// Called with the lock held, returns with it held
+static void runNext() {
+    size_t index = nextRun++;
+    Job job = ((Job*)jobs.array)[index];
+    pthread_mutex_unlock(&lock);
+    if (job.run)
+        job.run(job.data);
+    pthread_mutex_lock(&lock);
+    ((Job*)jobs.array)[index].done = true;
+    pthread_cond_broadcast(&jobDone);
+}
+
+static void* workerLoop(void* argument __attribute__((unused))) {
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (!stopping && nextRun == jobs.size)
+            pthread_cond_wait(&jobAvailable, &lock);
+        if (stopping)
+            break;
+        runNext();
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+void StartJobPool(unsigned int count) {
+    if (isRunning)
+        return;
+    if (count == 0)
+        count = coreCount() - 1;
+    if (count > JOB_POOL_MAX_WORKERS)
+        count = JOB_POOL_MAX_WORKERS;
+    initialize(&jobs, 32, sizeof(Job));
+    nextRun = nextFinish = 0;
+    stopping = false;
+    workerCount = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        if (pthread_create(&workers[workerCount], NULL, workerLoop, NULL) != 0) {
+            fprintf(stderr, "Error: Failed to start a job worker\n");
+            break;
+        }
+        ++workerCount;
+    }
+    isRunning = true;
+}
+
+unsigned int GetJobWorkerCount() {
+    return workerCount;
+}
+
+void SubmitJob(JobFunction run, JobFunction finish, void* data) {
+    if (!isRunning)
+        StartJobPool(0);
+    Job job = {.run = run, .finish = finish, .data = data, .done = false};
+    pthread_mutex_lock(&lock);
+    push(&jobs, &job);
+    pthread_cond_signal(&jobAvailable);
+    pthread_mutex_unlock(&lock);
+}
+
+// Runs finish callbacks until every submitted job, including ones submitted by those callbacks, is
+// finished. The calling thread picks up jobs no worker has started yet instead of sitting idle.
+void FinishJobs() {
+    if (!isRunning)
+        return;
+    pthread_mutex_lock(&lock);
+    while (nextFinish < jobs.size) {
+        if (!((Job*)jobs.array)[nextFinish].done) {
+            if (nextRun < jobs.size)
+                runNext();
+            else
+                pthread_cond_wait(&jobDone, &lock);
+            continue;
+        }
+        Job job = ((Job*)jobs.array)[nextFinish++];
+        pthread_mutex_unlock(&lock);
+        if (job.finish)
+            job.finish(job.data);
+        pthread_mutex_lock(&lock);
+    }
+    clearArray(&jobs, NULL);
+    nextRun = nextFinish = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+void StopJobPool() {
+    if (!isRunning)
+        return;
+    FinishJobs();
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&jobAvailable);
+    pthread_mutex_unlock(&lock);
+    for (unsigned int i = 0; i < workerCount; ++i)
+        pthread_join(workers[i], NULL);
+    cleanup(&jobs, NULL);
+    workerCount = 0;
+    isRunning = false;
+}
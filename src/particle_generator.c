@@ -1,19 +1,32 @@
 #include "particle_generator.h"
 
 #include <GL/glew.h>
+#include <GLFW/glfw3.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "gl_state.h"
 #include "mathc.h"
+#include "render_queue.h"
 #include "shader.h"
+#include "stream_buffer.h"
 #include "texture.h"
-#include "util.h"
 
-static DynamicArray particles;
-static unsigned int amount;
+// offset (vec2) + color (vec4) per live particle
+#define PARTICLE_INSTANCE_FLOATS 6
+
+static ParticlePool pool;
 static Shader shader;
 static Texture2D* texture;
 static unsigned int VAO;
+static StreamBuffer* stream;
+static float* instanceData;
+// Where DrawParticle left this frame's instances for drawParticles
+static size_t streamOffset;
+static unsigned int streamCount;
+static ParticleStats stats;
 
 static void init() {
     unsigned int VBO;
@@ -28,112 +41,173 @@ static void init() {
     };
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
+    stream = NewStreamBuffer((size_t)pool.amount * PARTICLE_INSTANCE_FLOATS * sizeof(float));
+    StateBindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    StateBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(particle_quad), particle_quad, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-    glBindVertexArray(0);
 
-    for (size_t i = 0; i < amount; ++i) {
-        pushPtr(&particles, NewParticle());
-    }
+    // instance pointers are set per draw, the data moves around the stream buffer
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    StateBindBuffer(GL_ARRAY_BUFFER, 0);
+    StateBindVertexArray(0);
+
+    pool.positions = calloc((size_t)pool.amount * VEC2_SIZE, sizeof(mfloat_t));
+    pool.previousPositions = calloc((size_t)pool.amount * VEC2_SIZE, sizeof(mfloat_t));
+    pool.velocities = calloc((size_t)pool.amount * VEC2_SIZE, sizeof(mfloat_t));
+    pool.colors = malloc((size_t)pool.amount * VEC4_SIZE * sizeof(mfloat_t));
+    pool.life = calloc(pool.amount, sizeof(float));
+    for (size_t i = 0; i < (size_t)pool.amount * VEC4_SIZE; ++i)
+        pool.colors[i] = 1.0f;
+    instanceData = malloc((size_t)pool.amount * PARTICLE_INSTANCE_FLOATS * sizeof(float));
 }
 
-static unsigned int lastUsedParticle = 0;
-static unsigned int firstUnusedParticle() {
-    for (unsigned int i = lastUsedParticle; i < amount; ++i) {
-        Particle* particle = ((Particle**)(particles.array))[i];
-        if (particle->life <= 0.0f) {
-            lastUsedParticle = i;
-            return i;
-        }
-    }
-    for (unsigned int i = 0; i < lastUsedParticle; ++i) {
-        Particle* particle = ((Particle**)(particles.array))[i];
-        if (particle->life <= 0.0f) {
-            lastUsedParticle = i;
-            return i;
-        }
-    }
-    lastUsedParticle = 0;
-    return 0;
+// Every particle lives for the same time, so the slot after the last spawned one is always the
+// oldest. Spawning walks the pool as a ring, which is O(1) even when the pool is saturated.
+static unsigned int nextParticle = 0;
+static unsigned int acquireParticle() {
+    unsigned int i = nextParticle;
+    nextParticle = (nextParticle + 1) % pool.amount;
+    return i;
 }
 
-static void respawnParticle(Particle* particle, BallObject* ball, mfloat_t* offset) {
+static void respawnParticle(unsigned int i, const BallObject* ball, mfloat_t* offset) {
     float random = ((rand() % 100) - 50) / 10.0f;
     float rColor = 0.5f + ((rand() % 100) / 100.0f);
-    vec2_add(particle->position, ball->base.position, vec2_add_f(offset, offset, random));
-    particle->color[0] = rColor;
-    particle->color[1] = rColor;
-    particle->color[2] = rColor;
-    particle->color[3] = 1.0f;
-    particle->life = 1.0f;
-    vec2_multiply_f(particle->velocity, ball->base.velocity, 0.1f);
-}
-
-static void cleanupParticlesCallback(void* item) {
-    Particle* particle = *(Particle**)item;
-    free(particle);
-}
-
-Particle* NewParticle() {
-    Particle* p = malloc(sizeof(Particle));
-    p->position[0] = 0.0f;
-    p->position[1] = 0.0f;
-    p->velocity[0] = 0.0f;
-    p->velocity[1] = 0.0f;
-    p->color[0] = 1.0f;
-    p->color[1] = 1.0f;
-    p->color[2] = 1.0f;
-    p->color[3] = 1.0f;
-    p->life = 0.0f;
-    return p;
+    vec2_add(&pool.positions[i * VEC2_SIZE], (mfloat_t*)ball->base.position, vec2_add_f(offset, offset, random));
+    vec2_assign(&pool.previousPositions[i * VEC2_SIZE], &pool.positions[i * VEC2_SIZE]);
+    mfloat_t* color = &pool.colors[i * VEC4_SIZE];
+    color[0] = rColor;
+    color[1] = rColor;
+    color[2] = rColor;
+    color[3] = 1.0f;
+    pool.life[i] = 1.0f;
+    vec2_multiply_f(&pool.velocities[i * VEC2_SIZE], (mfloat_t*)ball->base.velocity, 0.1f);
 }
 
 void NewParticleGenerator(Shader s, Texture2D* t, unsigned int a) {
     shader = s;
     texture = t;
-    amount = a;
-    initialize(&particles, 256, sizeof(Particle*));
+    pool.amount = a;
     init();
+    setVec4fv(shader, GetUniform(shader, "uvRect"), texture->uv, true);
 }
 
-void UpdateParticle(float dt, BallObject* ball, unsigned int newParticles, mfloat_t* offset) {
-    for (size_t i = 0; i < newParticles; ++i) {
-        int unusedParticle = firstUnusedParticle();
-        Particle* particle = ((Particle**)(particles.array))[unusedParticle];
-        respawnParticle(particle, ball, offset);
+// A particle lives for one second, so the pool takes amount * dt new ones per tick before it recycles
+// particles that are still visible. When the balls want more than that, the ones that emit rotate.
+static size_t nextEmitter = 0;
+void UpdateParticle(float dt, const BallObject* balls, size_t ballCount, unsigned int newParticles, const mfloat_t* offset) {
+    memcpy(pool.previousPositions, pool.positions, (size_t)pool.amount * VEC2_SIZE * sizeof(mfloat_t));
+    if (newParticles > 0 && ballCount > 0) {
+        size_t budget = (size_t)(pool.amount * dt);
+        size_t emitters = budget / newParticles > 1 ? budget / newParticles : 1;
+        if (emitters > ballCount)
+            emitters = ballCount;
+        for (size_t e = 0; e < emitters; ++e) {
+            const BallObject* ball = &balls[(nextEmitter + e) % ballCount];
+            mfloat_t spread[VEC2_SIZE] = {offset[0], offset[1]};
+            for (size_t i = 0; i < newParticles; ++i) {
+                respawnParticle(acquireParticle(), ball, spread);
+            }
+        }
+        nextEmitter = (nextEmitter + emitters) % ballCount;
     }
-    for (size_t i = 0; i < amount; ++i) {
-        Particle* p = ((Particle**)(particles.array))[i];
-        p->life -= dt;
-        if (p->life > 0.0f) {
-            mfloat_t multiply[VEC2_SIZE];
-            vec2_subtract(p->position, p->position, vec2_multiply_f(multiply, p->velocity, dt));
-            p->color[3] -= dt * 2.5f;
+    mfloat_t* positions = pool.positions;
+    mfloat_t* velocities = pool.velocities;
+    mfloat_t* colors = pool.colors;
+    float* life = pool.life;
+    for (size_t i = 0; i < pool.amount; ++i) {
+        life[i] -= dt;
+        if (life[i] > 0.0f) {
+            positions[i * VEC2_SIZE] -= velocities[i * VEC2_SIZE] * dt;
+            positions[i * VEC2_SIZE + 1] -= velocities[i * VEC2_SIZE + 1] * dt;
+            colors[i * VEC4_SIZE + 3] -= dt * 2.5f;
         }
     }
 }
 
-void DrawParticle() {
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    UseShader(shader);
-    DYNAMIC_ARRAY_FOR_EACH_PTR(&particles, Particle, p) {
-        if ((*p)->life > 0.0f) {
-            setVec2fv(shader, "offset", (*p)->position, false);
-            setVec4fv(shader, "color", (*p)->color, false);
-            BindTexture(texture);
-            glBindVertexArray(VAO);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-            glBindVertexArray(0);
+bool HasLiveParticles() {
+    for (size_t i = 0; i < pool.amount; ++i) {
+        if (pool.life[i] > 0.0f)
+            return true;
+    }
+    return false;
+}
+
+// Only live particles are copied out so the renderer can send them in one upload and one draw
+void SnapshotParticles(DynamicArray* particles) {
+    clearArray(particles, NULL);
+    for (size_t i = 0; i < pool.amount; ++i) {
+        if (pool.life[i] > 0.0f) {
+            ParticleState particle;
+            vec2_assign(particle.previousPosition, &pool.previousPositions[i * VEC2_SIZE]);
+            vec2_assign(particle.position, &pool.positions[i * VEC2_SIZE]);
+            vec4_assign(particle.color, &pool.colors[i * VEC4_SIZE]);
+            push(particles, &particle);
         }
     }
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+// The queue has bound the particle shader and texture and switched to additive blending
+static unsigned int drawParticles(void* data __attribute__((unused))) {
+    StateBindVertexArray(VAO);
+    StateBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, PARTICLE_INSTANCE_FLOATS * sizeof(float), (void*)streamOffset);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, PARTICLE_INSTANCE_FLOATS * sizeof(float), (void*)(streamOffset + 2 * sizeof(float)));
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, streamCount);
+    return 1;
+}
+
+void DrawParticle(RenderQueue* queue, const DynamicArray* particles, float alpha) {
+    unsigned int live = particles->size < pool.amount ? particles->size : pool.amount;
+    // particles are additive glow, drawing them untextured while the upload is pending would look worse than nothing
+    if (live == 0 || !IsTextureReady(texture))
+        return;
+    uint64_t start = glfwGetTimerValue();
+    const ParticleState* particle = (const ParticleState*)particles->array;
+    float* out = instanceData;
+    for (size_t i = 0; i < live; ++i, ++particle, out += PARTICLE_INSTANCE_FLOATS) {
+        vec2_lerp(out, (mfloat_t*)particle->previousPosition, (mfloat_t*)particle->position, alpha);
+        out[2] = particle->color[0];
+        out[3] = particle->color[1];
+        out[4] = particle->color[2];
+        out[5] = particle->color[3];
+    }
+
+    streamOffset = StreamData(stream, instanceData, (size_t)live * PARTICLE_INSTANCE_FLOATS * sizeof(float));
+    streamCount = live;
+    ++stats.draws;
+    stats.instances += live;
+    stats.packMilliseconds += (glfwGetTimerValue() - start) * 1000.0 / glfwGetTimerFrequency();
+    SubmitRenderItem(queue, RENDER_LAYER_PARTICLES, BLEND_ADDITIVE, shader, texture, drawParticles, NULL);
+}
+
+ParticleStats GetParticleStats() {
+    return stats;
+}
+
+unsigned int GetParticlePoolSize() {
+    return pool.amount;
 }
 
 void CleanupParticles() {
-    cleanup(&particles, cleanupParticlesCallback);
+    StateDeleteVertexArray(VAO);
+    DeleteStreamBuffer(stream);
+    free(pool.positions);
+    free(pool.previousPositions);
+    free(pool.velocities);
+    free(pool.colors);
+    free(pool.life);
+    free(instanceData);
+    pool = (ParticlePool){0};
+    nextParticle = 0;
+    nextEmitter = 0;
+    stats = (ParticleStats){0};
 }
@@ -4,11 +4,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "gl_state.h"
+#include "resource_manager.h"
 #include "shader.h"
 #include "texture.h"
 
-static unsigned int MSFBO, FBO;
-static unsigned int RBO;
+static unsigned int MSFBO = 0, FBO = 0;
+static unsigned int RBO = 0;
+// Background and bricks, matching the scene target so it can be blitted in sample for sample
+static unsigned int LayerFBO = 0, LayerRBO = 0;
+// Stands in for the default framebuffer when there is no window to present to
+static unsigned int OutputFBO = 0, OutputRBO = 0;
 static unsigned int VAO;
 
 static void initRenderData() {
@@ -25,47 +31,113 @@ static void initRenderData() {
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    StateBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    glBindVertexArray(VAO);
+    StateBindVertexArray(VAO);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    StateBindBuffer(GL_ARRAY_BUFFER, 0);
+    StateBindVertexArray(0);
 }
 
-PostProcessor* NewPostProcessor(Shader shader, unsigned int width, unsigned int height) {
-    PostProcessor* process = malloc(sizeof(PostProcessor));
-    process->postProcessingShader = shader;
-    process->texture = NewTexture();
-    process->width = width;
-    process->height = height;
-    process->confuse = false;
-    process->chaos = false;
-    process->shake = false;
+// Attachments are RGBA8 so a multisampled scene can be resolved straight into the offscreen output
+static void createFramebuffers(PostProcessor* process) {
+    GLint maxSamples;
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    if (process->samples > (unsigned int)maxSamples)
+        process->samples = maxSamples;
 
-    glGenFramebuffers(1, &MSFBO);
-    glGenFramebuffers(1, &FBO);
-    glGenRenderbuffers(1, &RBO);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, MSFBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, RBO);
-    GLint max_samples;
-    glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
-    glRenderbufferStorageMultisample(GL_RENDERBUFFER, max_samples, GL_RGB, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, RBO);
+    if (process->samples > 0) {
+        glGenFramebuffers(1, &MSFBO);
+        glGenRenderbuffers(1, &RBO);
+        StateBindFramebuffer(GL_FRAMEBUFFER, MSFBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, RBO);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, process->samples, GL_RGBA8, process->width, process->height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, RBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            fprintf(stderr, "Error: Failed to initialize MSFBO\n");
+    }
+
+    glGenFramebuffers(1, &LayerFBO);
+    glGenRenderbuffers(1, &LayerRBO);
+    StateBindFramebuffer(GL_FRAMEBUFFER, LayerFBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, LayerRBO);
+    if (process->samples > 0)
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, process->samples, GL_RGBA8, process->width, process->height);
+    else
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, process->width, process->height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, LayerRBO);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        fprintf(stderr, "Error: Failed to initialize MSFBO\n");
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-    GenerateTexture(process->texture, width, height, NULL);
+        fprintf(stderr, "Error: Failed to initialize layer FBO\n");
+    process->layerValid = false;
+
+    glGenFramebuffers(1, &FBO);
+    StateBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    GenerateTexture(process->texture, process->width, process->height, NULL);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, process->texture->ID, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         fprintf(stderr, "Error: Failed to initialize FBO\n");
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    initRenderData();
-    setInteger(process->postProcessingShader, "scene", 0, true);
+    if (process->offscreen) {
+        glGenFramebuffers(1, &OutputFBO);
+        glGenRenderbuffers(1, &OutputRBO);
+        StateBindFramebuffer(GL_FRAMEBUFFER, OutputFBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, OutputRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, process->width, process->height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, OutputRBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            fprintf(stderr, "Error: Failed to initialize output FBO\n");
+    }
+    StateBindFramebuffer(GL_FRAMEBUFFER, OutputFBO);
+}
+
+// The resolve texture is kept and re-specified by the next createFramebuffers
+static void destroyFramebuffers() {
+    if (MSFBO) {
+        StateDeleteFramebuffer(MSFBO);
+        glDeleteRenderbuffers(1, &RBO);
+        MSFBO = RBO = 0;
+    }
+    if (LayerFBO) {
+        StateDeleteFramebuffer(LayerFBO);
+        glDeleteRenderbuffers(1, &LayerRBO);
+        LayerFBO = LayerRBO = 0;
+    }
+    if (FBO) {
+        StateDeleteFramebuffer(FBO);
+        FBO = 0;
+    }
+    if (OutputFBO) {
+        StateDeleteFramebuffer(OutputFBO);
+        glDeleteRenderbuffers(1, &OutputRBO);
+        OutputFBO = OutputRBO = 0;
+    }
+}
+
+// Resource names of the effect variants, indexed by effect mask
+static char* variantNames[POST_PROCESS_VARIANTS] = {
+    "postprocessing",
+    "postprocessing_chaos",
+    "postprocessing_confuse",
+    "postprocessing_chaos_confuse",
+    "postprocessing_shake",
+    "postprocessing_chaos_shake",
+    "postprocessing_confuse_shake",
+    "postprocessing_chaos_confuse_shake",
+};
+
+static void initVariant(PostProcessVariant* variant, const char* vShaderFile, const char* fShaderFile, unsigned int mask) {
+    char defines[64];
+    snprintf(defines, sizeof(defines), "%s%s%s",
+        mask & POST_PROCESS_CHAOS ? "#define CHAOS\n" : "",
+        mask & POST_PROCESS_CONFUSE ? "#define CONFUSE\n" : "",
+        mask & POST_PROCESS_SHAKE ? "#define SHAKE\n" : "");
+    Shader shader = LoadShaderVariant(vShaderFile, fShaderFile, NULL, defines, variantNames[mask]);
+    variant->shader = shader;
+    // uniforms an effect does not use are compiled out of its variant, so look them up quietly
+    variant->timeUniform = FindUniform(shader, "time");
+    setInteger(shader, GetUniform(shader, "scene"), 0, true);
     float offset = 1.0f / 300.0f;
     float offsets[9][2] = {
         {-offset, offset},   // top-left
@@ -78,47 +150,151 @@ PostProcessor* NewPostProcessor(Shader shader, unsigned int width, unsigned int
         {0.0f, -offset},     // bottom-center
         {offset, -offset}    // bottom-right
     };
-    glUniform2fv(glGetUniformLocation(process->postProcessingShader, "offsets"), 9, (float*)offsets);
+    setVec2fArray(shader, FindUniform(shader, "offsets"), 9, (float*)offsets, false);
     int edge_kernel[9] = {
         -1, -1, -1,
         -1, 8, -1,
         -1, -1, -1};
-    glUniform1iv(glGetUniformLocation(process->postProcessingShader, "edge_kernel"), 9, edge_kernel);
+    setIntegerArray(shader, FindUniform(shader, "edge_kernel"), 9, edge_kernel, false);
     float blur_kernel[9] = {
         1.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f,
         2.0f / 16.0f, 4.0f / 16.0f, 2.0f / 16.0f,
         1.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f};
-    glUniform1fv(glGetUniformLocation(process->postProcessingShader, "blur_kernel"), 9, blur_kernel);
+    setFloatArray(shader, FindUniform(shader, "blur_kernel"), 9, blur_kernel, false);
+}
+
+PostProcessor* NewPostProcessor(const char* vShaderFile, const char* fShaderFile, unsigned int width, unsigned int height, unsigned int samples) {
+    PostProcessor* process = malloc(sizeof(PostProcessor));
+    process->texture = NewTexture();
+    process->texture->internalFormat = GL_RGBA8;
+    process->texture->imageFormat = GL_RGBA;
+    process->width = width;
+    process->height = height;
+    process->viewportWidth = width;
+    process->viewportHeight = height;
+    process->samples = samples;
+    process->offscreen = false;
+    process->confuse = false;
+    process->chaos = false;
+    process->shake = false;
+    process->layerValid = false;
+
+    createFramebuffers(process);
+
+    initRenderData();
+    // without effects the scene is blitted, so the plain variant is never drawn and not compiled
+    process->variants[0] = (PostProcessVariant){0, -1};
+    for (unsigned int mask = 1; mask < POST_PROCESS_VARIANTS; ++mask)
+        initVariant(&process->variants[mask], vShaderFile, fShaderFile, mask);
     return process;
 }
 
-void BeginPostProcessRender() {
-    glBindFramebuffer(GL_FRAMEBUFFER, MSFBO);
+void SetPostProcessSamples(PostProcessor* process, unsigned int samples) {
+    destroyFramebuffers();
+    process->samples = samples;
+    createFramebuffers(process);
+}
+
+void SetPostProcessOffscreen(PostProcessor* process, bool offscreen) {
+    destroyFramebuffers();
+    process->offscreen = offscreen;
+    createFramebuffers(process);
+}
+
+// The window's framebuffer can be larger than the scene, on HiDPI displays or after a resize.
+// The scene is still drawn at its own size and scaled up when presented.
+void SetPostProcessViewport(PostProcessor* process, unsigned int width, unsigned int height) {
+    process->viewportWidth = width;
+    process->viewportHeight = height;
+    glViewport(0, 0, width, height);
+}
+
+unsigned int GetPostProcessEffects(PostProcessor* process) {
+    return (process->chaos ? POST_PROCESS_CHAOS : 0) |
+           (process->confuse ? POST_PROCESS_CONFUSE : 0) |
+           (process->shake ? POST_PROCESS_SHAKE : 0);
+}
+
+bool HasPostProcessEffects(PostProcessor* process) {
+    return GetPostProcessEffects(process) != 0;
+}
+
+// Leaves the static layer bound and cleared, whatever is drawn next becomes the start of every scene
+void BeginPostProcessLayer(PostProcessor* process) {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glViewport(0, 0, process->width, process->height);
+    StateBindFramebuffer(GL_FRAMEBUFFER, LayerFBO);
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
-void EndPostProcessRender(PostProcessor* process) {
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, MSFBO);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+// The scene starts as a copy of the static layer instead of a clear
+void BeginPostProcessRender(PostProcessor* process) {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    // a window's framebuffer is cleared by the main loop, the offscreen output is ours to clear
+    if (process->offscreen) {
+        StateBindFramebuffer(GL_FRAMEBUFFER, OutputFBO);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    unsigned int scene = process->samples > 0 ? MSFBO : FBO;
+    glViewport(0, 0, process->width, process->height);
+    StateBindFramebuffer(GL_READ_FRAMEBUFFER, LayerFBO);
+    StateBindFramebuffer(GL_DRAW_FRAMEBUFFER, scene);
     glBlitFramebuffer(0, 0, process->width, process->height, 0, 0, process->width, process->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    StateBindFramebuffer(GL_FRAMEBUFFER, scene);
+}
+
+// Without an active effect the scene is presented here and RenderPostProcess has nothing left to do.
+// The offscreen output matches the scene in size and format, so a multisampled scene is resolved straight
+// into it. A window's framebuffer guarantees neither: the scene is resolved into FBO first and scaled
+// to the framebuffer on the way, just like the effect quad is.
+void EndPostProcessRender(PostProcessor* process) {
+    bool present = !HasPostProcessEffects(process);
+    if (present && process->offscreen) {
+        StateBindFramebuffer(GL_READ_FRAMEBUFFER, process->samples > 0 ? MSFBO : FBO);
+        StateBindFramebuffer(GL_DRAW_FRAMEBUFFER, OutputFBO);
+        glBlitFramebuffer(0, 0, process->width, process->height, 0, 0, process->width, process->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    } else {
+        if (process->samples > 0) {
+            StateBindFramebuffer(GL_READ_FRAMEBUFFER, MSFBO);
+            StateBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+            glBlitFramebuffer(0, 0, process->width, process->height, 0, 0, process->width, process->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+        if (present) {
+            bool scaled = process->viewportWidth != process->width || process->viewportHeight != process->height;
+            StateBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+            StateBindFramebuffer(GL_DRAW_FRAMEBUFFER, OutputFBO);
+            glBlitFramebuffer(0, 0, process->width, process->height, 0, 0, process->viewportWidth, process->viewportHeight,
+                GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+        }
+    }
+    glViewport(0, 0, process->viewportWidth, process->viewportHeight);
+    StateBindFramebuffer(GL_FRAMEBUFFER, OutputFBO);
 }
 
 void RenderPostProcess(PostProcessor* process, float time) {
-    UseShader(process->postProcessingShader);
-    setFloat(process->postProcessingShader, "time", time, false);
-    setInteger(process->postProcessingShader, "confuse", process->confuse, false);
-    setInteger(process->postProcessingShader, "chaos", process->chaos, false);
-    setInteger(process->postProcessingShader, "shake", process->shake, false);
-    glActiveTexture(GL_TEXTURE0);
+    unsigned int mask = GetPostProcessEffects(process);
+    if (mask == 0)
+        return;
+    PostProcessVariant* variant = &process->variants[mask];
+    UseShader(variant->shader);
+    if (variant->timeUniform >= 0)
+        setFloat(variant->shader, variant->timeUniform, time, false);
+    StateActiveTexture(GL_TEXTURE0);
     BindTexture(process->texture);
-    glBindVertexArray(VAO);
+    StateBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+}
+
+// Reads the presented frame as bottom-up RGBA rows of width * height pixels
+void ReadPostProcessOutput(PostProcessor* process, unsigned char* pixels) {
+    StateBindFramebuffer(GL_READ_FRAMEBUFFER, OutputFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, process->width, process->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 }
 
 void CleanupPostProcess(PostProcessor* process) {
+    destroyFramebuffers();
+    StateDeleteTexture(process->texture->ID);
     free(process->texture);
     free(process);
 }
@@ -12,6 +12,8 @@ PowerUp* NewPowerUp(char* type, mfloat_t* color, float duration, mfloat_t* posit
 
     powerup->base.position[0] = position[0];
     powerup->base.position[1] = position[1];
+    powerup->base.previousPosition[0] = position[0];
+    powerup->base.previousPosition[1] = position[1];
 
     powerup->base.size[0] = POWERUP_SIZE[0];
     powerup->base.size[1] = POWERUP_SIZE[1];
@@ -25,6 +27,7 @@ PowerUp* NewPowerUp(char* type, mfloat_t* color, float duration, mfloat_t* posit
     powerup->base.velocity[0] = VELOCITY[0];
     powerup->base.velocity[1] = VELOCITY[1];
 
+    powerup->base.rotation = 0.0f;
     powerup->base.isSolid = false;
     powerup->base.destroyed = false;
 
@@ -35,9 +38,6 @@ PowerUp* NewPowerUp(char* type, mfloat_t* color, float duration, mfloat_t* posit
     return powerup;
 }
 
-void DrawPowerUp(PowerUp* powerup, SpriteRenderer* renderer) {
-    DrawSprite(renderer, powerup->base.sprite, powerup->base.position, powerup->base.size, powerup->base.rotation, powerup->base.color);
-}
 void CleanupPowerUp(PowerUp* powerup) {
     CleanupGameObject(&powerup->base);
     free(powerup);
@@ -1,24 +1,417 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 #include "game.h"
+#include "gl_state.h"
+#include "gpu_timer.h"
+#include "particle_generator.h"
 #include "resource_manager.h"
+#include "sim_timer.h"
+#include "stream_buffer.h"
+#include "texture.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
+void window_refresh_callback(GLFWwindow* window);
+void window_iconify_callback(GLFWwindow* window, int iconified);
+void window_focus_callback(GLFWwindow* window, int focused);
 
 #define factor 80
 #define SCREEN_WIDTH (factor * 16)
 #define SCREEN_HEIGHT (factor * 9)
 
+#define DEFAULT_TICK_RATE 60
+#define DEFAULT_MAX_STEPS 5
+// Display rate the headless clock pretends to run at
+#define HEADLESS_FRAME_RATE 60
+
 Game Breakout;
 
-int main() {
+typedef struct {
+    bool headless;
+    unsigned int frames;
+    const char* dumpFile;
+    const char* timingsFile;
+    bool play;
+    unsigned int tickRate;  // simulation ticks per second
+    unsigned int maxSteps;  // ticks run per rendered frame at most, the rest of a stall is dropped
+    unsigned int balls;     // balls put in play at once, more than one is a stress test
+    unsigned int particles;  // size of the particle pool
+} Options;
+
+// Window state tracked by the main thread. While paused the simulation does not tick and the renderer
+// keeps presenting the last frame, while hidden it does not draw at all.
+static atomic_bool windowHidden = false, windowUnfocused = false;
+
+static bool isPaused() {
+    return atomic_load(&windowHidden) || atomic_load(&windowUnfocused);
+}
+
+// Set by key_callback when a key went down or up, only that ends idling. Both run on the main thread.
+static bool keysChanged = false;
+
+static pthread_mutex_t wakeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeSignal = PTHREAD_COND_INITIALIZER;
+static bool wakePending = false;
+
+// Something the renderer shows changed: a new snapshot, the window or the size of its framebuffer.
+// A wake that arrives while the renderer is still drawing is kept, so it never sleeps through one.
+static void wakeRenderer() {
+    pthread_mutex_lock(&wakeLock);
+    wakePending = true;
+    pthread_cond_signal(&wakeSignal);
+    pthread_mutex_unlock(&wakeLock);
+}
+
+static void waitForWake() {
+    pthread_mutex_lock(&wakeLock);
+    while (!wakePending)
+        pthread_cond_wait(&wakeSignal, &wakeLock);
+    wakePending = false;
+    pthread_mutex_unlock(&wakeLock);
+}
+
+// Accumulates elapsed time in ticks of the integer GLFW timer and spends it in fixed simulation steps
+typedef struct {
+    uint64_t accumulator;
+    uint64_t tickLength;
+    uint64_t lastTime;
+    float tickSeconds;
+    unsigned int maxSteps;
+} FixedStep;
+
+static FixedStep newFixedStep(const Options* options, uint64_t now) {
+    return (FixedStep){
+        .accumulator = 0,
+        .tickLength = glfwGetTimerFrequency() / options->tickRate,
+        .lastTime = now,
+        .tickSeconds = 1.0f / options->tickRate,
+        .maxSteps = options->maxSteps,
+    };
+}
+
+// Runs the ticks that fit in the time since the last call and publishes the result for the renderer.
+// The snapshot is stamped with the time its last tick ended, which is the leftover time ago.
+static void advanceSimulation(FixedStep* step, uint64_t now) {
+    step->accumulator += now - step->lastTime;
+    step->lastTime = now;
+    unsigned int steps = 0;
+    while (step->accumulator >= step->tickLength && steps < step->maxSteps) {
+        StepGame(&Breakout, step->tickSeconds);
+        step->accumulator -= step->tickLength;
+        ++steps;
+    }
+    if (step->accumulator >= step->tickLength)
+        step->accumulator %= step->tickLength;
+    if (steps > 0) {
+        PublishGameSnapshot(&Breakout, now - step->accumulator);
+        wakeRenderer();
+    }
+}
+
+// Ticking stops while idle or paused, when it resumes one tick is due at once so input is handled
+// right away and the time spent waiting is not caught up on
+static void resumeSimulation(FixedStep* step, uint64_t now) {
+    step->lastTime = now;
+    step->accumulator = step->tickLength;
+}
+
+// How far the render time is past the snapshot's tick, 0 draws the tick before it and 1 the tick itself
+static float interpolationAlpha(uint64_t tickLength, uint64_t now, uint64_t snapshotTime) {
+    if (now <= snapshotTime)
+        return 0.0f;
+    double alpha = (double)(now - snapshotTime) / tickLength;
+    return alpha < 1.0 ? (float)alpha : 1.0f;
+}
+
+// Renders the latest published snapshot as fast as the swap chain allows, the counters feed the window title.
+// Once it has drawn a frame that would look the same drawn again it sleeps until woken by wakeRenderer.
+typedef struct {
+    GLFWwindow* window;
+    uint64_t tickLength;
+    atomic_bool running;
+    atomic_uint frames;
+    atomic_uint drawCalls;
+    atomic_uint stateChanges;
+    atomic_uint stateElided;
+    atomic_uint streamedBytes;
+} RenderThread;
+
+// Framebuffer size reported by GLFW on the main thread, applied by the thread owning the context
+static atomic_int framebufferWidth = SCREEN_WIDTH, framebufferHeight = SCREEN_HEIGHT;
+
+static void* renderLoop(void* argument) {
+    RenderThread* thread = (RenderThread*)argument;
+    glfwMakeContextCurrent(thread->window);
+    int viewportWidth = SCREEN_WIDTH, viewportHeight = SCREEN_HEIGHT;
+    bool presented = false, sleep = false;
+    while (atomic_load(&thread->running)) {
+        if (sleep) {
+            waitForWake();
+            sleep = false;
+            continue;
+        }
+        // nothing is visible, the next wake comes when the window is restored
+        if (atomic_load(&windowHidden)) {
+            sleep = true;
+            continue;
+        }
+        int width = atomic_load(&framebufferWidth), height = atomic_load(&framebufferHeight);
+        if (width != viewportWidth || height != viewportHeight) {
+            SetGameViewport(&Breakout, width, height);
+            viewportWidth = width;
+            viewportHeight = height;
+        }
+        BeginStateFrame();
+        BeginGpuFrame();
+        BeginStreamFrame();
+        PollTextureUploads();
+
+        uint64_t snapshotTime = 0;
+        float alpha = 1.0f;
+        bool acquired = AcquireGameSnapshot(&Breakout, &snapshotTime);
+        // a frame that will be presented until the next wake is drawn at its tick, not part way to it
+        bool still = acquired && (IsGameFrameIdle(&Breakout) || isPaused()) && !HasPendingTextureUploads();
+        if (acquired && !still)
+            alpha = interpolationAlpha(thread->tickLength, glfwGetTimerValue(), snapshotTime);
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        RenderGame(&Breakout, alpha);
+
+        glfwSwapBuffers(thread->window);
+        // the GLFW timer starts at glfwInit, right at the beginning of main
+        if (!presented) {
+            printf("Startup: first frame after %.1f ms\n", glfwGetTime() * 1000.0);
+            presented = true;
+        }
+
+        StateStats stateStats = GetStateStats();
+        atomic_store(&thread->drawCalls, Breakout.drawCalls);
+        atomic_store(&thread->stateChanges, stateStats.totalIssued);
+        atomic_store(&thread->stateElided, stateStats.totalElided);
+        atomic_store(&thread->streamedBytes, (unsigned int)GetStreamStats().bytes);
+        atomic_fetch_add(&thread->frames, 1u);
+        sleep = still;
+    }
+    glfwMakeContextCurrent(NULL);
+    return NULL;
+}
+
+static bool parseOptions(int argc, char** argv, Options* options) {
+    *options = (Options){.headless = false, .frames = 600, .dumpFile = NULL, .timingsFile = NULL, .play = false,
+        .tickRate = DEFAULT_TICK_RATE, .maxSteps = DEFAULT_MAX_STEPS, .balls = 1,
+        .particles = GAME_DEFAULT_PARTICLES};
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            options->headless = true;
+        } else if (strcmp(argv[i], "--play") == 0) {
+            options->play = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options->frames = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            options->dumpFile = argv[++i];
+        } else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc) {
+            options->timingsFile = argv[++i];
+        } else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            options->tickRate = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            options->maxSteps = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--balls") == 0 && i + 1 < argc) {
+            options->balls = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            options->particles = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--tick-rate N] [--max-steps N] [--balls N] [--particles N] [--timings file.csv] [--headless [--frames N] [--dump file.ppm] [--play]]\n", argv[0]);
+            return false;
+        }
+    }
+    if (options->tickRate == 0 || options->maxSteps == 0 || options->balls == 0 || options->particles == 0) {
+        fprintf(stderr, "Error: --tick-rate, --max-steps, --balls and --particles must be positive\n");
+        return false;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+// Surfaceless EGL context, Mesa renders it in software (llvmpipe) when there is no GPU
+static bool createHeadlessContext() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!getPlatformDisplay) {
+        fprintf(stderr, "Error: EGL_EXT_platform_base is not available\n");
+        return false;
+    }
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        fprintf(stderr, "Error: Failed to initialize a surfaceless EGL display\n");
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    EGLint configAttributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+    EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+    EGLContext context = eglCreateContext(display, configCount > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "Error: Failed to create a surfaceless OpenGL 3.3 context\n");
+        return false;
+    }
+    return true;
+}
+
+static void dumpFrame(const char* file) {
+    unsigned char* pixels = malloc((size_t)SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+    ReadGameFrame(&Breakout, pixels);
+    FILE* out = fopen(file, "wb");
+    if (!out) {
+        fprintf(stderr, "Error: Could not open %s for writing\n", file);
+        free(pixels);
+        return;
+    }
+    // binary PPM, rows flipped from GL's bottom-up order
+    fprintf(out, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    for (int y = SCREEN_HEIGHT - 1; y >= 0; --y) {
+        for (int x = 0; x < SCREEN_WIDTH; ++x)
+            fwrite(&pixels[((size_t)y * SCREEN_WIDTH + x) * 4], 1, 3, out);
+    }
+    fclose(out);
+    free(pixels);
+}
+#endif
+
+// Renders a fixed number of frames at a fixed step into the post processor framebuffers and reports the cost
+static int runHeadless(const Options* options) {
+#ifdef _WIN32
+    (void)options;
+    fprintf(stderr, "Error: Headless mode is only supported on Linux\n");
+    return EXIT_FAILURE;
+#else
+    // the null platform needs no display but still provides glfwGetTime
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    if (!glfwInit() || !createHeadlessContext()) {
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
+    // GLEW looks for a GLX display after loading the entry points, which an EGL context does not have
+    glewExperimental = GL_TRUE;
+    GLenum glewStatus = glewInit();
+    if (glewStatus != GLEW_OK && glewStatus != GLEW_ERROR_NO_GLX_DISPLAY) {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    printf("Headless: %s | %s\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+
+    glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    glEnable(GL_BLEND);
+    StateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    NewGame(&Breakout, SCREEN_WIDTH, SCREEN_HEIGHT);
+    Breakout.startingBalls = options->balls;
+    Breakout.particles = options->particles;
+    Breakout.offscreen = true;
+    InitGame(&Breakout);
+    if (options->play) {
+        Breakout.state = GAME_ACTIVE;
+        Breakout.keys[GLFW_KEY_SPACE] = true;
+    }
+
+    // simulated time advances by exactly one display frame per rendered frame, so runs are reproducible.
+    // Simulation and rendering take turns on this thread, which keeps the output deterministic.
+    uint64_t clock = 0;
+    FixedStep step = newFixedStep(options, clock);
+    PublishGameSnapshot(&Breakout, clock);
+    const uint64_t frameLength = glfwGetTimerFrequency() / HEADLESS_FRAME_RATE;
+    unsigned int drawCalls = 0, stateChanges = 0, fenceWaits = 0;
+    size_t streamedBytes = 0;
+    double fenceWaitTime = 0.0;
+    double start = glfwGetTime();
+    for (unsigned int frame = 0; frame < options->frames; ++frame) {
+        BeginStateFrame();
+        BeginGpuFrame();
+        BeginStreamFrame();
+        PollTextureUploads();
+        StreamStats streamStats = GetStreamStats();
+        streamedBytes += streamStats.bytes;
+        fenceWaits += streamStats.fenceWaits;
+        fenceWaitTime += streamStats.waitMilliseconds;
+        clock += frameLength;
+        advanceSimulation(&step, clock);
+        uint64_t snapshotTime = 0;
+        AcquireGameSnapshot(&Breakout, &snapshotTime);
+        RenderGame(&Breakout, interpolationAlpha(step.tickLength, clock, snapshotTime));
+        if (frame == 0) {
+            glFinish();
+            printf("Headless: first frame after %.1f ms\n", glfwGetTime() * 1000.0);
+        }
+        drawCalls += Breakout.drawCalls;
+        stateChanges += GetStateStats().totalIssued;
+    }
+    // the last frame's uploads are only counted once the next frame begins
+    BeginStreamFrame();
+    streamedBytes += GetStreamStats().bytes;
+    glFinish();
+    double elapsed = glfwGetTime() - start;
+
+    unsigned int frames = options->frames > 0 ? options->frames : 1;
+    printf("Headless: %u frames in %.3f s | %.3f ms/frame | %.1f draw calls/frame | %.1f state changes/frame\n",
+        options->frames, elapsed, elapsed * 1000.0 / frames, drawCalls / (double)frames, stateChanges / (double)frames);
+    printf("Headless: %s streaming | %.1f KB/frame | %u fence waits, %.3f ms blocked\n",
+        IsStreamPersistent() ? "persistent" : "orphaned", streamedBytes / 1024.0 / frames, fenceWaits, fenceWaitTime);
+    for (GpuPass pass = 0; pass < GPU_PASS_COUNT; ++pass)
+        printf("Headless: gpu %-8s %.3f ms\n", GetGpuPassName(pass), GetGpuPassTime(pass));
+    for (SimPhase phase = 0; phase < SIM_PHASE_COUNT; ++phase)
+        printf("Headless: sim %-9s %.3f ms/tick\n", GetSimPhaseName(phase), GetSimPhaseTime(phase));
+    printf("Headless: sim %-9s %.3f ms/tick, --balls %u\n", "total", GetSimTickTime(), options->balls);
+    ParticleStats particleStats = GetParticleStats();
+    printf("Headless: particles pool %u | %.0f drawn/frame | %.3f ms/frame packing | sim %.3f ms/tick\n",
+        GetParticlePoolSize(), particleStats.instances / (double)frames, particleStats.packMilliseconds / frames,
+        GetSimPhaseTime(SIM_PHASE_PARTICLES));
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+        fprintf(stderr, "Error: OpenGL error 0x%x\n", error);
+    if (options->dumpFile)
+        dumpFrame(options->dumpFile);
+    if (options->timingsFile)
+        WriteGpuTimingsCsv(options->timingsFile);
+
+    CleanupGpuTimers();
+    ClearResources();
+    glfwTerminate();
+    return error == GL_NO_ERROR ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, &options))
+        return EXIT_FAILURE;
+    if (options.headless)
+        return runHeadless(&options);
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -53,35 +446,103 @@ int main() {
 
     glfwSetKeyCallback(window, key_callback);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    glfwSetWindowIconifyCallback(window, window_iconify_callback);
+    glfwSetWindowFocusCallback(window, window_focus_callback);
+    // on HiDPI displays the framebuffer starts out larger than the window, the render thread picks that up
+    int pixelWidth, pixelHeight;
+    glfwGetFramebufferSize(window, &pixelWidth, &pixelHeight);
+    framebuffer_size_callback(window, pixelWidth, pixelHeight);
 
     glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
     glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    StateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     NewGame(&Breakout, SCREEN_WIDTH, SCREEN_HEIGHT);
+    Breakout.startingBalls = options.balls;
+    Breakout.particles = options.particles;
     InitGame(&Breakout);
 
-    float deltaTime = 0.0f;
-    float lastFrame = 0.0f;
+    // The context moves to the render thread, this thread keeps events and the simulation
+    FixedStep step = newFixedStep(&options, glfwGetTimerValue());
+    PublishGameSnapshot(&Breakout, step.lastTime);
+    glfwMakeContextCurrent(NULL);
+    RenderThread renderThread = {.window = window, .tickLength = step.tickLength};
+    atomic_init(&renderThread.running, true);
+    atomic_init(&renderThread.frames, 0u);
+    atomic_init(&renderThread.drawCalls, 0u);
+    atomic_init(&renderThread.stateChanges, 0u);
+    atomic_init(&renderThread.stateElided, 0u);
+    atomic_init(&renderThread.streamedBytes, 0u);
+    pthread_t renderer;
+    if (pthread_create(&renderer, NULL, renderLoop, &renderThread) != 0) {
+        fprintf(stderr, "Error: Failed to start the render thread\n");
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
 
+    const uint64_t timerFrequency = glfwGetTimerFrequency();
+    uint64_t lastReport = step.lastTime;
+    bool paused = false, idle = false;
     while (!glfwWindowShouldClose(window)) {
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        glfwPollEvents();
-
-        ProcessGameInput(&Breakout, deltaTime);
-
-        UpdateGame(&Breakout, deltaTime);
-
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        RenderGame(&Breakout);
+        // sleep until the next tick is due, input still wakes this thread right away.
+        // With nothing to simulate there is no next tick and only an event ends the wait.
+        if (paused || idle)
+            glfwWaitEvents();
+        else
+            glfwWaitEventsTimeout((double)(step.tickLength - step.accumulator) / timerFrequency);
+        uint64_t now = glfwGetTimerValue();
+        if (isPaused()) {
+            if (!paused)
+                glfwSetWindowTitle(window, "Breakout | paused");
+            paused = true;
+            continue;
+        }
+        if (paused) {
+            paused = false;
+            if (idle)
+                glfwSetWindowTitle(window, "Breakout | idle");
+            else
+                resumeSimulation(&step, now);
+        }
+        // cursor motion, focus and refresh events wake this thread too but leave an idle game asleep,
+        // the renderer presents the last frame again for those that need it
+        if (idle) {
+            if (!keysChanged)
+                continue;
+            resumeSimulation(&step, now);
+        }
+        keysChanged = false;
+        advanceSimulation(&step, now);
+        if (IsGameIdle(&Breakout)) {
+            if (!idle)
+                glfwSetWindowTitle(window, "Breakout | idle");
+            idle = true;
+            lastReport = now;
+            continue;
+        }
+        idle = false;
 
-        glfwSwapBuffers(window);
+        // Report frame rate, draw calls and state changes of the last frame once per second
+        if (now - lastReport >= timerFrequency) {
+            char title[160];
+            snprintf(title, sizeof(title), "Breakout | %u fps | %u draw calls | %u state changes, %u elided | %.1f KB streamed",
+                atomic_exchange(&renderThread.frames, 0u), atomic_load(&renderThread.drawCalls),
+                atomic_load(&renderThread.stateChanges), atomic_load(&renderThread.stateElided),
+                atomic_load(&renderThread.streamedBytes) / 1024.0);
+            glfwSetWindowTitle(window, title);
+            lastReport = now;
+        }
     }
 
+    atomic_store(&renderThread.running, false);
+    wakeRenderer();
+    pthread_join(renderer, NULL);
+    glfwMakeContextCurrent(window);
+
+    if (options.timingsFile)
+        WriteGpuTimingsCsv(options.timingsFile);
+    CleanupGpuTimers();
     ClearResources();
 
     glfwTerminate();
@@ -92,15 +553,34 @@ void key_callback(GLFWwindow* window, int key, int scancode __attribute__((unuse
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, 1);
     if (key >= 0 && key < 1024) {
-        if (action == GLFW_PRESS)
+        if (action == GLFW_PRESS) {
             Breakout.keys[key] = true;
-        else if (action == GLFW_RELEASE) {
+            keysChanged = true;
+        } else if (action == GLFW_RELEASE) {
             Breakout.keys[key] = false;
             Breakout.keysProcessed[key] = false;
+            keysChanged = true;
         }
     }
 }
 
 void framebuffer_size_callback(GLFWwindow* window __attribute__((unused)), int width, int height) {
-    glViewport(0, 0, width, height);
+    atomic_store(&framebufferWidth, width);
+    atomic_store(&framebufferHeight, height);
+    wakeRenderer();
+}
+
+// The window system lost the window's contents, present the last frame again
+void window_refresh_callback(GLFWwindow* window __attribute__((unused))) {
+    wakeRenderer();
+}
+
+void window_iconify_callback(GLFWwindow* window __attribute__((unused)), int iconified) {
+    atomic_store(&windowHidden, iconified == GLFW_TRUE);
+    wakeRenderer();
+}
+
+void window_focus_callback(GLFWwindow* window __attribute__((unused)), int focused) {
+    atomic_store(&windowUnfocused, focused != GLFW_TRUE);
+    wakeRenderer();
 }
@@ -0,0 +1,184 @@
+#include "render_queue.h"
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "sprite_renderer.h"
+#include "stream_buffer.h"
+#include "texture.h"
+#include "util.h"
+
+#define KEY_SEQUENCE_BITS 24
+#define KEY_TEXTURE_BITS 24
+#define KEY_SHADER_BITS 10
+#define KEY_BLEND_BITS 2
+#define KEY_TEXTURE_SHIFT KEY_SEQUENCE_BITS
+#define KEY_SHADER_SHIFT (KEY_TEXTURE_SHIFT + KEY_TEXTURE_BITS)
+#define KEY_BLEND_SHIFT (KEY_SHADER_SHIFT + KEY_SHADER_BITS)
+#define KEY_LAYER_SHIFT (KEY_BLEND_SHIFT + KEY_BLEND_BITS)
+#define KEY_FIELD(value, bits) ((uint64_t)(value) & ((UINT64_C(1) << (bits)) - 1))
+
+// Everything above the sequence, items with the same state can share one draw
+#define KEY_STATE_MASK (~((UINT64_C(1) << KEY_SEQUENCE_BITS) - 1))
+
+static uint64_t makeKey(RenderLayer layer, BlendMode blend, Shader shader, Texture2D* texture, size_t sequence) {
+    return ((uint64_t)layer << KEY_LAYER_SHIFT) |
+           (KEY_FIELD(blend, KEY_BLEND_BITS) << KEY_BLEND_SHIFT) |
+           (KEY_FIELD(shader, KEY_SHADER_BITS) << KEY_SHADER_SHIFT) |
+           (KEY_FIELD(texture ? texture->ID : 0, KEY_TEXTURE_BITS) << KEY_TEXTURE_SHIFT) |
+           KEY_FIELD(sequence, KEY_SEQUENCE_BITS);
+}
+
+static void applyBlend(BlendMode blend) {
+    if (blend == BLEND_ADDITIVE)
+        StateBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    else
+        StateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+RenderQueue* NewRenderQueue(SpriteRenderer* sprites) {
+    RenderQueue* queue = malloc(sizeof(RenderQueue));
+    queue->sprites = sprites;
+    initialize(&queue->items, 64, sizeof(RenderItem));
+    initialize(&queue->entries, 64, sizeof(RenderSortEntry));
+    initialize(&queue->scratch, 64, sizeof(RenderSortEntry));
+    initialize(&queue->instances, 64, sizeof(SpriteInstance));
+    return queue;
+}
+
+static void pushItem(RenderQueue* queue, RenderItem* item, RenderLayer layer, BlendMode blend) {
+    item->key = makeKey(layer, blend, item->shader, item->texture, queue->items.size);
+    push(&queue->items, item);
+}
+
+void SubmitSpriteItem(RenderQueue* queue, RenderLayer layer, Texture2D* texture, mfloat_t* position, mfloat_t* size, float rotate, mfloat_t* color) {
+    RenderItem item = {
+        .shader = queue->sprites->shader,
+        .texture = texture,
+        .draw = NULL,
+        .data = NULL,
+        .instance = MakeSpriteCommand(texture, position, size, rotate, color).instance,
+    };
+    pushItem(queue, &item, layer, BLEND_ALPHA);
+}
+
+void SubmitRenderItem(RenderQueue* queue, RenderLayer layer, BlendMode blend, Shader shader, Texture2D* texture, RenderCallback draw, void* data) {
+    RenderItem item = {
+        .shader = shader,
+        .texture = texture,
+        .draw = draw,
+        .data = data,
+    };
+    pushItem(queue, &item, layer, blend);
+}
+
+// LSD radix sort over the eight key bytes. Bytes every key has in common would leave the order as
+// it is and are skipped, which with few layers and textures is most of them.
+static RenderSortEntry* sortEntries(RenderQueue* queue) {
+    size_t count = queue->items.size;
+    clearArray(&queue->entries, NULL);
+    clearArray(&queue->scratch, NULL);
+    const RenderItem* items = (const RenderItem*)queue->items.array;
+    for (size_t i = 0; i < count; ++i) {
+        RenderSortEntry entry = {.key = items[i].key, .item = (uint32_t)i};
+        push(&queue->entries, &entry);
+    }
+    insert(&queue->scratch, 0, queue->entries.array, count);
+
+    size_t histograms[8][256] = {{0}};
+    RenderSortEntry* from = (RenderSortEntry*)queue->entries.array;
+    RenderSortEntry* to = (RenderSortEntry*)queue->scratch.array;
+    for (size_t i = 0; i < count; ++i) {
+        for (unsigned int digit = 0; digit < 8; ++digit)
+            ++histograms[digit][(from[i].key >> (digit * 8)) & 0xff];
+    }
+
+    for (unsigned int digit = 0; digit < 8; ++digit) {
+        size_t* histogram = histograms[digit];
+        unsigned int shift = digit * 8;
+        if (histogram[(from[0].key >> shift) & 0xff] == count)
+            continue;
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < 256; ++bucket) {
+            size_t size = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += size;
+        }
+        for (size_t i = 0; i < count; ++i)
+            to[histogram[(from[i].key >> shift) & 0xff]++] = from[i];
+        RenderSortEntry* swap = from;
+        from = to;
+        to = swap;
+    }
+    return from;
+}
+
+// Sorts and draws everything submitted since the last call, then empties the queue.
+// Returns the number of draw calls issued.
+unsigned int ExecuteRenderQueue(RenderQueue* queue) {
+    size_t count = queue->items.size;
+    if (count == 0)
+        return 0;
+
+    RenderSortEntry* sorted = sortEntries(queue);
+    const RenderItem* items = (const RenderItem*)queue->items.array;
+
+    // all sprite instances go up in one upload, in the order they are drawn
+    clearArray(&queue->instances, NULL);
+    for (size_t i = 0; i < count; ++i) {
+        const RenderItem* item = &items[sorted[i].item];
+        if (!item->draw)
+            push(&queue->instances, &item->instance);
+    }
+    size_t offset = 0;
+    if (queue->instances.size > 0)
+        offset = StreamData(queue->sprites->stream, queue->instances.array, queue->instances.size * sizeof(SpriteInstance));
+
+    unsigned int drawCalls = 0;
+    size_t instance = 0;
+    size_t i = 0;
+    while (i < count) {
+        const RenderItem* item = &items[sorted[i].item];
+        applyBlend((BlendMode)KEY_FIELD(item->key >> KEY_BLEND_SHIFT, KEY_BLEND_BITS));
+        if (item->draw) {
+            UseShader(item->shader);
+            if (item->texture) {
+                StateActiveTexture(GL_TEXTURE0);
+                BindTexture(item->texture);
+            }
+            drawCalls += item->draw(item->data);
+            ++i;
+            continue;
+        }
+        // sprites with the same state up to the sequence share one instanced draw
+        uint64_t state = item->key & KEY_STATE_MASK;
+        size_t runEnd = i + 1;
+        while (runEnd < count) {
+            const RenderItem* next = &items[sorted[runEnd].item];
+            if (next->draw || (next->key & KEY_STATE_MASK) != state)
+                break;
+            ++runEnd;
+        }
+        DrawSpriteRun(queue->sprites, item->texture, offset, instance, runEnd - i);
+        ++drawCalls;
+        instance += runEnd - i;
+        i = runEnd;
+    }
+    // everything else draws with plain alpha blending
+    applyBlend(BLEND_ALPHA);
+
+    clearArray(&queue->items, NULL);
+    return drawCalls;
+}
+
+void DestroyRenderQueue(RenderQueue* queue) {
+    cleanup(&queue->items, NULL);
+    cleanup(&queue->entries, NULL);
+    cleanup(&queue->scratch, NULL);
+    cleanup(&queue->instances, NULL);
+    free(queue);
+}
@@ -1,12 +1,54 @@
 #include "resource_manager.h"
 
 #include <GL/glew.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "gl_state.h"
+#include "job_pool.h"
 #include "shader.h"
-#include "stb_image.h"
 #include "texture.h"
+#include "texture_cache.h"
 #include "util.h"
 
+#define ATLAS_MAX_PAGE_SIZE 2048
+#define ATLAS_PADDING 1
+
+typedef struct {
+    const TextureSource* source;
+    CachedImage image;
+    const unsigned char* pixels;  // always RGBA, NULL when the image could not be loaded or placed
+    int width, height;
+    int x, y;  // top-left of the padded cell inside its page
+    unsigned int page;
+} AtlasImage;
+
+typedef struct {
+    int y, height, cursor;
+} AtlasShelf;
+
+typedef struct {
+    DynamicArray shelves;
+    int usedHeight;
+} AtlasPage;
+
+// Images of one atlas, decoded by workers and packed once all of them are in
+typedef struct {
+    const TextureSource* sources;
+    size_t count;
+    AtlasImage* images;
+} AtlasLoad;
+
+// Shader sources read by a worker, compiled where the context is current
+typedef struct {
+    char* vertex;
+    char* fragment;
+    char* geometry;
+    const char* files[3];
+    char* defines;
+    char* name;
+} ShaderLoad;
+
 static ResourceManager instance;
 static uint8_t isInitialized = 0;
 
@@ -14,11 +56,12 @@ static void initializeResourceManager() {
     if (!isInitialized) {
         initMap(&instance.shaders);
         initMap(&instance.textures);
+        initialize(&instance.atlasPages, 4, sizeof(Texture2D*));
         isInitialized = 1;
     }
 }
 
-static Shader loadShaderFromFile(const char* vShaderFile, const char* fShaderFile, const char* gShaderFile) {
+static Shader loadShaderFromFile(const char* vShaderFile, const char* fShaderFile, const char* gShaderFile, const char* defines) {
     char* vShaderCode = readFile(vShaderFile);
     char* fShaderCode = readFile(fShaderFile);
     char* gShaderCode = NULL;
@@ -27,7 +70,7 @@ static Shader loadShaderFromFile(const char* vShaderFile, const char* fShaderFil
         gShaderCode = readFile(gShaderFile);
     }
 
-    Shader shader = NewShader(vShaderCode, fShaderCode, gShaderFile != NULL ? gShaderCode : NULL);
+    Shader shader = NewShader(vShaderCode, fShaderCode, gShaderFile != NULL ? gShaderCode : NULL, defines);
 
     free(vShaderCode);
     free(fShaderCode);
@@ -66,12 +109,13 @@ static Texture2D* loadTextureFromFile(const char* file, bool alpha) {
         texture->imageFormat = GL_RGBA;
     }
 
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(file, &width, &height, &nrChannels, 0);
-
-    GenerateTexture(texture, width, height, data);
-
-    stbi_image_free(data);
+    CachedImage image;
+    if (!LoadCachedImage(file, 0, &image)) {
+        fprintf(stderr, "Error: Failed to load texture %s\n", file);
+        return texture;
+    }
+    GenerateTextureAsync(texture, image.width, image.height, image.pixels);
+    ReleaseCachedImage(&image);
     return texture;
 }
 
@@ -96,20 +140,118 @@ static Texture2D* getFromTexture(Key key) {
     return (Texture2D*)result;
 }
 
+static int compareAtlasImages(const void* a, const void* b) {
+    const AtlasImage* lhs = *(const AtlasImage**)a;
+    const AtlasImage* rhs = *(const AtlasImage**)b;
+    if (lhs->height != rhs->height)
+        return rhs->height - lhs->height;
+    return rhs->width - lhs->width;
+}
+
+// First-fit shelf packing: reuse the first shelf that is tall enough and has room left,
+// otherwise open a new shelf below the last one
+static bool packIntoPage(AtlasPage* page, AtlasImage* image, int pageSize) {
+    int w = image->width + 2 * ATLAS_PADDING;
+    int h = image->height + 2 * ATLAS_PADDING;
+
+    DYNAMIC_ARRAY_FOR_EACH(&page->shelves, AtlasShelf, shelf) {
+        if (h <= shelf->height && shelf->cursor + w <= pageSize) {
+            image->x = shelf->cursor;
+            image->y = shelf->y;
+            shelf->cursor += w;
+            return true;
+        }
+    }
+    if (page->usedHeight + h > pageSize || w > pageSize)
+        return false;
+
+    AtlasShelf shelf = {.y = page->usedHeight, .height = h, .cursor = w};
+    push(&page->shelves, &shelf);
+    image->x = 0;
+    image->y = page->usedHeight;
+    page->usedHeight += h;
+    return true;
+}
+
+// Copy the image into the page and extrude its border into the padding so linear filtering
+// never samples a neighbouring region
+static void blitIntoPage(unsigned char* pagePixels, int pageSize, AtlasImage* image) {
+    int rowWidth = image->width + 2 * ATLAS_PADDING;
+    for (int row = -ATLAS_PADDING; row < image->height + ATLAS_PADDING; ++row) {
+        int srcRow = row < 0 ? 0 : (row >= image->height ? image->height - 1 : row);
+        const unsigned char* src = image->pixels + (size_t)srcRow * image->width * 4;
+        unsigned char* dst = pagePixels + ((size_t)(image->y + ATLAS_PADDING + row) * pageSize + image->x) * 4;
+
+        for (int p = 0; p < ATLAS_PADDING; ++p) {
+            memcpy(dst + p * 4, src, 4);
+            memcpy(dst + (ATLAS_PADDING + image->width + p) * 4, src + (image->width - 1) * 4, 4);
+        }
+        memcpy(dst + ATLAS_PADDING * 4, src, (size_t)image->width * 4);
+        // opaque textures were uploaded as RGB before, keep ignoring whatever alpha the file has.
+        // Done on the page copy because the source pixels may be a read-only cache mapping.
+        if (!image->source->alpha) {
+            for (int x = 0; x < rowWidth; ++x)
+                dst[x * 4 + 3] = 255;
+        }
+    }
+}
+
 static void clearShaders(Key key __attribute__((unused)), void* value, void* context __attribute__((unused))) {
-    glDeleteProgram(*(Shader*)value);
+    DeleteShader(*(Shader*)value);
 }
 
 static void clearTextures(Key key __attribute__((unused)), void* value, void* context __attribute__((unused))) {
-    glDeleteTextures(1, &((Texture2D*)value)->ID);
+    Texture2D* texture = (Texture2D*)value;
+    if (!texture->isRegion)
+        StateDeleteTexture(texture->ID);
+    free(texture);
+}
+
+static void clearAtlasPages(void* item) {
+    Texture2D* page = *(Texture2D**)item;
+    StateDeleteTexture(page->ID);
+    free(page);
 }
 
 Shader LoadShader(const char* vShaderFile, const char* fShaderFile, const char* gShaderFile, char* name) {
+    return LoadShaderVariant(vShaderFile, fShaderFile, gShaderFile, NULL, name);
+}
+
+Shader LoadShaderVariant(const char* vShaderFile, const char* fShaderFile, const char* gShaderFile, const char* defines, char* name) {
     Key key = {.type = KEY_TYPE_STRING, .strKey = name};
-    addShader(key, loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile));
+    addShader(key, loadShaderFromFile(vShaderFile, fShaderFile, gShaderFile, defines));
     return getFromShader(key);
 }
 
+static void readShaderSources(void* data) {
+    ShaderLoad* load = (ShaderLoad*)data;
+    load->vertex = readFile(load->files[0]);
+    load->fragment = readFile(load->files[1]);
+    load->geometry = load->files[2] ? readFile(load->files[2]) : NULL;
+}
+
+static void compileShaderSources(void* data) {
+    ShaderLoad* load = (ShaderLoad*)data;
+    addShader((Key){.type = KEY_TYPE_STRING, .strKey = load->name}, NewShader(load->vertex, load->fragment, load->geometry, load->defines));
+    free(load->vertex);
+    free(load->fragment);
+    free(load->geometry);
+    free(load->defines);
+    free(load);
+}
+
+// Reads the sources on a worker and compiles them in FinishJobs, GetShader works from then on.
+// The file names must stay valid until then, the defines are copied.
+void LoadShaderVariantAsync(const char* vShaderFile, const char* fShaderFile, const char* gShaderFile, const char* defines, char* name) {
+    ShaderLoad* load = calloc(1, sizeof(ShaderLoad));
+    load->files[0] = vShaderFile;
+    load->files[1] = fShaderFile;
+    load->files[2] = gShaderFile;
+    load->defines = defines ? custom_strdup(defines) : NULL;
+    load->name = name;
+    SubmitJob(readShaderSources, compileShaderSources, load);
+}
+
 Shader GetShader(char* name) {
     Key key = {.type = KEY_TYPE_STRING, .strKey = name};
     return getFromShader(key);
@@ -121,6 +263,132 @@ Texture2D* LoadTexture(const char* file, bool alpha, char* name) {
     return getFromTexture(key);
 }
 
+static void decodeAtlasImage(void* data) {
+    AtlasImage* image = (AtlasImage*)data;
+    if (!LoadCachedImage(image->source->file, 4, &image->image)) {
+        fprintf(stderr, "Error: Failed to load texture %s\n", image->source->file);
+        return;
+    }
+    image->pixels = image->image.pixels;
+    image->width = image->image.width;
+    image->height = image->image.height;
+}
+
+static void buildAtlas(void* data) {
+    AtlasLoad* load = (AtlasLoad*)data;
+    size_t count = load->count;
+    AtlasImage* images = load->images;
+
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    int pageSize = maxTextureSize < ATLAS_MAX_PAGE_SIZE ? maxTextureSize : ATLAS_MAX_PAGE_SIZE;
+
+    AtlasImage** order = malloc((count > 0 ? count : 1) * sizeof(AtlasImage*));
+    size_t loaded = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (images[i].pixels)
+            order[loaded++] = &images[i];
+    }
+    qsort(order, loaded, sizeof(AtlasImage*), compareAtlasImages);
+
+    DynamicArray pages;
+    initialize(&pages, 2, sizeof(AtlasPage));
+    for (size_t i = 0; i < loaded; ++i) {
+        AtlasImage* image = order[i];
+        bool placed = false;
+        for (size_t p = 0; p < pages.size && !placed; ++p) {
+            if (packIntoPage(&((AtlasPage*)pages.array)[p], image, pageSize)) {
+                image->page = p;
+                placed = true;
+            }
+        }
+        if (!placed) {
+            AtlasPage page = {.usedHeight = 0};
+            initialize(&page.shelves, 8, sizeof(AtlasShelf));
+            push(&pages, &page);
+            image->page = pages.size - 1;
+            if (!packIntoPage(&((AtlasPage*)pages.array)[image->page], image, pageSize)) {
+                fprintf(stderr, "Error: Texture %s does not fit into a %dx%d atlas page\n", image->source->file, pageSize, pageSize);
+                image->pixels = NULL;
+            }
+        }
+    }
+
+    for (size_t p = 0; p < pages.size; ++p) {
+        AtlasPage* page = &((AtlasPage*)pages.array)[p];
+        unsigned char* pagePixels = calloc((size_t)pageSize * page->usedHeight, 4);
+        for (size_t i = 0; i < loaded; ++i) {
+            if (order[i]->pixels && order[i]->page == p)
+                blitIntoPage(pagePixels, pageSize, order[i]);
+        }
+
+        Texture2D* pageTexture = NewTexture();
+        pageTexture->internalFormat = GL_RGBA;
+        pageTexture->imageFormat = GL_RGBA;
+        pageTexture->wrapS = GL_CLAMP_TO_EDGE;
+        pageTexture->wrapT = GL_CLAMP_TO_EDGE;
+        GenerateTextureAsync(pageTexture, pageSize, page->usedHeight, pagePixels);
+        pushPtr(&instance.atlasPages, pageTexture);
+        free(pagePixels);
+
+        for (size_t i = 0; i < loaded; ++i) {
+            AtlasImage* image = order[i];
+            if (!image->pixels || image->page != p)
+                continue;
+
+            Texture2D* region = malloc(sizeof(Texture2D));
+            *region = *pageTexture;
+            region->width = image->width;
+            region->height = image->height;
+            region->uv[0] = (image->x + ATLAS_PADDING) / (float)pageTexture->width;
+            region->uv[1] = (image->y + ATLAS_PADDING) / (float)pageTexture->height;
+            region->uv[2] = (image->x + ATLAS_PADDING + image->width) / (float)pageTexture->width;
+            region->uv[3] = (image->y + ATLAS_PADDING + image->height) / (float)pageTexture->height;
+            region->isRegion = true;
+            region->page = pageTexture;
+            addTexture((Key){.type = KEY_TYPE_STRING, .strKey = image->source->name}, region);
+        }
+        cleanup(&page->shelves, NULL);
+    }
+
+    for (size_t i = 0; i < loaded; ++i)
+        ReleaseCachedImage(&order[i]->image);
+    cleanup(&pages, NULL);
+    free(order);
+    free(images);
+    free(load);
+}
+
+static AtlasLoad* newAtlasLoad(const TextureSource* sources, size_t count) {
+    if (!isInitialized)
+        initializeResourceManager();
+    AtlasLoad* load = malloc(sizeof(AtlasLoad));
+    load->sources = sources;
+    load->count = count;
+    load->images = calloc(count > 0 ? count : 1, sizeof(AtlasImage));
+    for (size_t i = 0; i < count; ++i)
+        load->images[i].source = &sources[i];
+    return load;
+}
+
+void LoadTextureAtlas(const TextureSource* sources, size_t count) {
+    AtlasLoad* load = newAtlasLoad(sources, count);
+    for (size_t i = 0; i < count; ++i)
+        decodeAtlasImage(&load->images[i]);
+    buildAtlas(load);
+}
+
+// Decodes every image on a worker and packs and uploads the pages in FinishJobs.
+// The sources must stay valid until then.
+void LoadTextureAtlasAsync(const TextureSource* sources, size_t count) {
+    AtlasLoad* load = newAtlasLoad(sources, count);
+    for (size_t i = 0; i < count; ++i)
+        SubmitJob(decodeAtlasImage, NULL, &load->images[i]);
+    // finish callbacks run in submission order, so every image is decoded by the time this one runs
+    SubmitJob(NULL, buildAtlas, load);
+}
+
+
 Texture2D* GetTexture(char* name) {
     Key key = {.type = KEY_TYPE_STRING, .strKey = name};
     return getFromTexture(key);
@@ -129,12 +397,14 @@ Texture2D* GetTexture(char* name) {
 void ClearResources() {
     if (!isInitialized)
         initializeResourceManager();
+    FinishTextureUploads();
 
     traverseInOrder(instance.shaders.root, instance.shaders.nil, clearShaders, NULL);
     freeMap(&instance.shaders);
 
     traverseInOrder(instance.textures.root, instance.textures.nil, clearTextures, NULL);
     freeMap(&instance.textures);
+    cleanup(&instance.atlasPages, clearAtlasPages);
 
     isInitialized = 0;
 }
@@ -2,8 +2,16 @@
 
 #include <GL/glew.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "gl_state.h"
+#include "util.h"
+
+static DynamicArray reflections;
+static bool reflectionsInitialized = false;
+static unsigned int matricesUBO = 0;
+
 static void checkShaderCompileErrors(unsigned int object, const char* type) {
     int success;
     char infoLog[1024];
@@ -22,25 +30,66 @@ static void checkShaderCompileErrors(unsigned int object, const char* type) {
     }
 }
 
-Shader NewShader(const char* vertexSource, const char* fragmentSource, const char* geometrySource) {
-    unsigned int sVertex, sFragment, gShader;
+// Record the location of every active uniform once, so setters never query GL by name
+static void reflectUniforms(Shader shaderID) {
+    if (!reflectionsInitialized) {
+        initialize(&reflections, 8, sizeof(ShaderReflection));
+        reflectionsInitialized = true;
+    }
+
+    GLint count = 0;
+    glGetProgramiv(shaderID, GL_ACTIVE_UNIFORMS, &count);
+    ShaderReflection reflection = {
+        .program = shaderID,
+        .uniforms = calloc(count > 0 ? count : 1, sizeof(ShaderUniformInfo)),
+        .count = 0,
+    };
+    for (GLint i = 0; i < count; ++i) {
+        ShaderUniformInfo* info = &reflection.uniforms[reflection.count];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(shaderID, i, sizeof(info->name), NULL, &size, &type, info->name);
+        info->location = glGetUniformLocation(shaderID, info->name);
+        // members of uniform blocks have no location and are fed through buffers instead
+        if (info->location < 0)
+            continue;
+        // arrays are reported as "name[0]", store them under their plain name
+        char* bracket = strchr(info->name, '[');
+        if (bracket)
+            *bracket = '\0';
+        ++reflection.count;
+    }
+    push(&reflections, &reflection);
+
+    GLuint blockIndex = glGetUniformBlockIndex(shaderID, "Matrices");
+    if (blockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(shaderID, blockIndex, MATRICES_BLOCK_BINDING);
+}
 
-    sVertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(sVertex, 1, &vertexSource, NULL);
-    glCompileShader(sVertex);
-    checkShaderCompileErrors(sVertex, "VERTEX");
-
-    sFragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(sFragment, 1, &fragmentSource, NULL);
-    glCompileShader(sFragment);
-    checkShaderCompileErrors(sFragment, "FRAGMENT");
-
-    if (geometrySource != NULL) {
-        gShader = glCreateShader(GL_GEOMETRY_SHADER);
-        glShaderSource(gShader, 1, &geometrySource, NULL);
-        glCompileShader(gShader);
-        checkShaderCompileErrors(gShader, "GEOMETRY");
+// Defines are spliced in right after the #version line, which must stay first in the source.
+// A #line directive keeps compiler messages pointing at the lines of the original file.
+static unsigned int compileStage(unsigned int type, const char* source, const char* defines, const char* name) {
+    unsigned int stage = glCreateShader(type);
+    const char* newline = strchr(source, '\n');
+    if (defines && newline) {
+        const char* parts[4] = {source, defines, "\n#line 2\n", newline + 1};
+        GLint lengths[4] = {(GLint)(newline + 1 - source), -1, -1, -1};
+        glShaderSource(stage, 4, parts, lengths);
+    } else {
+        glShaderSource(stage, 1, &source, NULL);
     }
+    glCompileShader(stage);
+    checkShaderCompileErrors(stage, name);
+    return stage;
+}
+
+Shader NewShader(const char* vertexSource, const char* fragmentSource, const char* geometrySource, const char* defines) {
+    unsigned int sVertex, sFragment, gShader;
+
+    sVertex = compileStage(GL_VERTEX_SHADER, vertexSource, defines, "VERTEX");
+    sFragment = compileStage(GL_FRAGMENT_SHADER, fragmentSource, defines, "FRAGMENT");
+    if (geometrySource != NULL)
+        gShader = compileStage(GL_GEOMETRY_SHADER, geometrySource, defines, "GEOMETRY");
 
     Shader shaderID = glCreateProgram();
     glAttachShader(shaderID, sVertex);
@@ -55,55 +104,123 @@ Shader NewShader(const char* vertexSource, const char* fragmentSource, const cha
     if (geometrySource != NULL)
         glDeleteShader(gShader);
 
+    reflectUniforms(shaderID);
+
     return shaderID;
 }
 
+void DeleteShader(Shader shaderID) {
+    if (reflectionsInitialized) {
+        ShaderReflection* entries = (ShaderReflection*)reflections.array;
+        for (size_t i = 0; i < reflections.size; ++i) {
+            if (entries[i].program == shaderID) {
+                free(entries[i].uniforms);
+                entries[i] = entries[reflections.size - 1];
+                --reflections.size;
+                break;
+            }
+        }
+    }
+    StateDeleteProgram(shaderID);
+}
+
 void UseShader(Shader shaderID) {
-    glUseProgram(shaderID);
+    StateUseProgram(shaderID);
 }
 
-void setFloat(Shader shaderID, const char* name, float value, bool useShader) {
+ShaderUniform FindUniform(Shader shaderID, const char* name) {
+    if (reflectionsInitialized) {
+        DYNAMIC_ARRAY_FOR_EACH(&reflections, ShaderReflection, reflection) {
+            if (reflection->program != shaderID)
+                continue;
+            for (unsigned int i = 0; i < reflection->count; ++i) {
+                if (strcmp(reflection->uniforms[i].name, name) == 0)
+                    return reflection->uniforms[i].location;
+            }
+            break;
+        }
+    }
+    return -1;
+}
+
+ShaderUniform GetUniform(Shader shaderID, const char* name) {
+    ShaderUniform uniform = FindUniform(shaderID, name);
+    if (uniform < 0)
+        fprintf(stderr, "Error: Uniform %s not found in shader %u\n", name, shaderID);
+    return uniform;
+}
+
+void SetSharedProjection(mfloat_t* matrix) {
+    if (matricesUBO == 0) {
+        glGenBuffers(1, &matricesUBO);
+        StateBindBuffer(GL_UNIFORM_BUFFER, matricesUBO);
+        glBufferData(GL_UNIFORM_BUFFER, MAT4_SIZE * sizeof(float), NULL, GL_STATIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, MATRICES_BLOCK_BINDING, matricesUBO);
+    }
+    float projection[MAT4_SIZE];
+    for (size_t i = 0; i < MAT4_SIZE; ++i)
+        projection[i] = (float)matrix[i];
+    StateBindBuffer(GL_UNIFORM_BUFFER, matricesUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(projection), projection);
+}
+
+void setFloat(Shader shaderID, ShaderUniform uniform, float value, bool useShader) {
+    if (useShader)
+        UseShader(shaderID);
+    glUniform1f(uniform, value);
+}
+void setInteger(Shader shaderID, ShaderUniform uniform, int value, bool useShader) {
+    if (useShader)
+        UseShader(shaderID);
+    glUniform1i(uniform, value);
+}
+void setVec2f(Shader shaderID, ShaderUniform uniform, float x, float y, bool useShader) {
+    if (useShader)
+        UseShader(shaderID);
+    glUniform2f(uniform, x, y);
+}
+void setVec2fv(Shader shaderID, ShaderUniform uniform, mfloat_t* value, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniform1f(glGetUniformLocation(shaderID, name), value);
+    glUniform2fv(uniform, 1, value);
 }
-void setInteger(Shader shaderID, const char* name, int value, bool useShader) {
+void setVec3f(Shader shaderID, ShaderUniform uniform, float x, float y, float z, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniform1i(glGetUniformLocation(shaderID, name), value);
+    glUniform3f(uniform, x, y, z);
 }
-void setVec2f(Shader shaderID, const char* name, float x, float y, bool useShader) {
+void setVec3fv(Shader shaderID, ShaderUniform uniform, mfloat_t* value, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniform2f(glGetUniformLocation(shaderID, name), x, y);
+    glUniform3fv(uniform, 1, value);
 }
-void setVec2fv(Shader shaderID, const char* name, mfloat_t* value, bool useShader) {
+void setVec4f(Shader shaderID, ShaderUniform uniform, float x, float y, float z, float w, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniform2fv(glGetUniformLocation(shaderID, name), 1, value);
+    glUniform4f(uniform, x, y, z, w);
 }
-void setVec3f(Shader shaderID, const char* name, float x, float y, float z, bool useShader) {
+void setVec4fv(Shader shaderID, ShaderUniform uniform, mfloat_t* value, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniform3f(glGetUniformLocation(shaderID, name), x, y, z);
+    glUniform4fv(uniform, 1, value);
 }
-void setVec3fv(Shader shaderID, const char* name, mfloat_t* value, bool useShader) {
+void setMat4fv(Shader shaderID, ShaderUniform uniform, mfloat_t* matrix, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniform3fv(glGetUniformLocation(shaderID, name), 1, value);
+    glUniformMatrix4fv(uniform, 1, GL_FALSE, matrix);
 }
-void setVec4f(Shader shaderID, const char* name, float x, float y, float z, float w, bool useShader) {
+void setIntegerArray(Shader shaderID, ShaderUniform uniform, int count, int* values, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniform4f(glGetUniformLocation(shaderID, name), x, y, z, w);
+    glUniform1iv(uniform, count, values);
 }
-void setVec4fv(Shader shaderID, const char* name, mfloat_t* value, bool useShader) {
+void setFloatArray(Shader shaderID, ShaderUniform uniform, int count, float* values, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniform4fv(glGetUniformLocation(shaderID, name), 1, value);
+    glUniform1fv(uniform, count, values);
 }
-void setMat4fv(Shader shaderID, const char* name, mfloat_t* matrix, bool useShader) {
+void setVec2fArray(Shader shaderID, ShaderUniform uniform, int count, float* values, bool useShader) {
     if (useShader)
         UseShader(shaderID);
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, name), 1, GL_FALSE, matrix);
+    glUniform2fv(uniform, count, values);
 }
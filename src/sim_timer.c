@@ -0,0 +1,62 @@
+#include "sim_timer.h"
+
+#include <GLFW/glfw3.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static const char* phaseNames[SIM_PHASE_COUNT] = {"input", "balls", "particles", "powerups", "publish"};
+
+static int activePhase = -1;
+static uint64_t phaseStart;
+// Time spent in each phase since the last EndSimTick, a phase may run more than once per tick
+static double pending[SIM_PHASE_COUNT];
+
+// Ring of per-tick results in milliseconds, oldest first starting at historyStart
+static float history[SIM_TIMER_HISTORY][SIM_PHASE_COUNT];
+static unsigned int historyStart = 0, historyCount = 0;
+static double sums[SIM_PHASE_COUNT];
+
+void BeginSimPhase(SimPhase phase) {
+    if (activePhase >= 0)
+        return;
+    activePhase = phase;
+    phaseStart = glfwGetTimerValue();
+}
+
+void EndSimPhase() {
+    if (activePhase < 0)
+        return;
+    pending[activePhase] += (glfwGetTimerValue() - phaseStart) * 1000.0 / glfwGetTimerFrequency();
+    activePhase = -1;
+}
+
+void EndSimTick() {
+    unsigned int slot = (historyStart + historyCount) % SIM_TIMER_HISTORY;
+    if (historyCount == SIM_TIMER_HISTORY) {
+        for (size_t phase = 0; phase < SIM_PHASE_COUNT; ++phase)
+            sums[phase] -= history[historyStart][phase];
+        historyStart = (historyStart + 1) % SIM_TIMER_HISTORY;
+    } else {
+        ++historyCount;
+    }
+    for (size_t phase = 0; phase < SIM_PHASE_COUNT; ++phase) {
+        history[slot][phase] = (float)pending[phase];
+        sums[phase] += pending[phase];
+        pending[phase] = 0.0;
+    }
+}
+
+const char* GetSimPhaseName(SimPhase phase) {
+    return phaseNames[phase];
+}
+
+float GetSimPhaseTime(SimPhase phase) {
+    return historyCount > 0 ? (float)(sums[phase] / historyCount) : 0.0f;
+}
+
+float GetSimTickTime() {
+    float total = 0.0f;
+    for (SimPhase phase = 0; phase < SIM_PHASE_COUNT; ++phase)
+        total += GetSimPhaseTime(phase);
+    return total;
+}
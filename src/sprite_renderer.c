@@ -1,15 +1,38 @@
 #include "sprite_renderer.h"
 
 #include <GL/glew.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "gl_state.h"
 #include "mathc.h"
 #include "shader.h"
+#include "stream_buffer.h"
 #include "texture.h"
+#include "util.h"
+
+// Per-vertex quad from quadVBO plus the instanced attributes read from instanceVBO,
+// the instance pointers are re-specified per texture run before drawing
+static void initInstancedVAO(unsigned int VAO, unsigned int quadVBO, unsigned int instanceVBO) {
+    StateBindVertexArray(VAO);
+    StateBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+
+    StateBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    StateBindBuffer(GL_ARRAY_BUFFER, 0);
+    StateBindVertexArray(0);
+}
 
 static void initRenderData(SpriteRenderer* renderer) {
-    unsigned int VBO;
     float vertices[] = {
         // pos      // tex
         0.0f, 1.0f, 0.0f, 1.0f,
@@ -22,16 +45,46 @@ static void initRenderData(SpriteRenderer* renderer) {
     };
 
     glGenVertexArrays(1, &renderer->quadVAO);
-    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &renderer->quadVBO);
+    renderer->stream = NewStreamBuffer(256 * sizeof(SpriteInstance));
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    unsigned char white[4] = {255, 255, 255, 255};
+    renderer->placeholder = NewTexture();
+    renderer->placeholder->internalFormat = GL_RGBA;
+    renderer->placeholder->imageFormat = GL_RGBA;
+    GenerateTexture(renderer->placeholder, 1, 1, white);
+
+    StateBindBuffer(GL_ARRAY_BUFFER, renderer->quadVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    glBindVertexArray(renderer->quadVAO);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    initInstancedVAO(renderer->quadVAO, renderer->quadVBO, renderer->stream->buffer);
+}
+
+static int compareCommands(const void* a, const void* b) {
+    const SpriteCommand* lhs = (const SpriteCommand*)a;
+    const SpriteCommand* rhs = (const SpriteCommand*)b;
+    if (lhs->texture->ID != rhs->texture->ID)
+        return lhs->texture->ID < rhs->texture->ID ? -1 : 1;
+    // keep submission order inside a texture run
+    return lhs->sequence < rhs->sequence ? -1 : (lhs->sequence > rhs->sequence);
+}
+
+// Sprites whose texture is still uploading keep their color but sample the white placeholder
+static void bindSpriteTexture(SpriteRenderer* renderer, Texture2D* texture) {
+    if (IsTextureReady(texture)) {
+        BindTexture(texture);
+    } else {
+        BindTexture(renderer->placeholder);
+        ++renderer->placeholderDraws;
+    }
+}
+
+// offset is where the instances start in the bound buffer, first the instance of the run inside them
+static void setInstancePointers(size_t offset, size_t first) {
+    size_t base = offset + first * sizeof(SpriteInstance);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, rect)));
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, color)));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, uv)));
 }
 
 SpriteRenderer* NewSpriteRenderer(Shader shader) {
@@ -39,37 +92,117 @@ SpriteRenderer* NewSpriteRenderer(Shader shader) {
     *renderer = (SpriteRenderer){
         .shader = shader,
         .quadVAO = 0,
+        .quadVBO = 0,
+        .stream = NULL,
+        .placeholder = NULL,
+        .placeholderDraws = 0,
     };
     initRenderData(renderer);
     return renderer;
 }
 
-void DrawSprite(SpriteRenderer* renderer, Texture2D* texture, mfloat_t* position, mfloat_t* size, float rotate, mfloat_t* color) {
+SpriteCommand MakeSpriteCommand(Texture2D* texture, mfloat_t* position, mfloat_t* size, float rotate, mfloat_t* color) {
+    SpriteCommand command = {
+        .texture = texture,
+        .sequence = 0,
+        .instance = {
+            .rect = {position[0], position[1], size[0], size[1]},
+            .color = {1.0f, 1.0f, 1.0f},
+            .rotation = MRADIANS(rotate),
+            .uv = {texture->uv[0], texture->uv[1], texture->uv[2], texture->uv[3]},
+        },
+    };
+    if (color) {
+        command.instance.color[0] = color[0];
+        command.instance.color[1] = color[1];
+        command.instance.color[2] = color[2];
+    }
+    return command;
+}
+
+// Draws count instances that were streamed at offset, starting at instance first, all with one texture
+void DrawSpriteRun(SpriteRenderer* renderer, Texture2D* texture, size_t offset, size_t first, size_t count) {
     UseShader(renderer->shader);
-    mfloat_t identity[MAT4_SIZE];
-    mfloat_t model[MAT4_SIZE];
-    mat4_translate(model, mat4_identity(identity), (mfloat_t[VEC3_SIZE]){position[0], position[1], 0.0f});
-    mat4_translate(identity, mat4_identity(identity), (mfloat_t[VEC3_SIZE]){0.5f * size[0], 0.5f * size[1], 0.0f});
-    mat4_multiply(model, model, identity);
-    mat4_rotation_axis(identity, (mfloat_t[VEC3_SIZE]){0.0f, 0.0f, 1.0f}, MRADIANS(rotate));
-    mat4_multiply(model, model, identity);
-    mat4_translate(identity, mat4_identity(identity), (mfloat_t[VEC3_SIZE]){-0.5f * size[0], -0.5f * size[1], 0.0f});
-    mat4_multiply(model, model, identity);
-    mat4_scale(identity, mat4_identity(identity), (mfloat_t[VEC3_SIZE]){size[0], size[1], 1.0f});
-    mat4_multiply(model, model, identity);
-
-    setMat4fv(renderer->shader, "model", model, false);
-    setVec3fv(renderer->shader, "spriteColor", color == NULL ? (mfloat_t[]){1.0f, 1.0f, 1.0f} : color, false);
-
-    glActiveTexture(GL_TEXTURE0);
-    BindTexture(texture);
-
-    glBindVertexArray(renderer->quadVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+    StateActiveTexture(GL_TEXTURE0);
+    StateBindVertexArray(renderer->quadVAO);
+    StateBindBuffer(GL_ARRAY_BUFFER, renderer->stream->buffer);
+    bindSpriteTexture(renderer, texture);
+    setInstancePointers(offset, first);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+}
+
+StaticSprites* NewStaticSprites(SpriteRenderer* renderer, SpriteCommand* commands, size_t count) {
+    StaticSprites* sprites = malloc(sizeof(StaticSprites));
+    sprites->count = count;
+    sprites->slots = malloc((count > 0 ? count : 1) * sizeof(size_t));
+    sprites->instances = malloc((count > 0 ? count : 1) * sizeof(SpriteInstance));
+    initialize(&sprites->runs, 4, sizeof(SpriteRun));
+
+    for (size_t i = 0; i < count; ++i)
+        commands[i].sequence = i;
+    qsort(commands, count, sizeof(SpriteCommand), compareCommands);
+    for (size_t i = 0; i < count; ++i) {
+        sprites->instances[i] = commands[i].instance;
+        sprites->slots[commands[i].sequence] = i;
+        if (i == 0 || commands[i].texture->ID != commands[i - 1].texture->ID) {
+            SpriteRun run = {.texture = commands[i].texture, .first = i, .count = 0};
+            push(&sprites->runs, &run);
+        }
+        ++((SpriteRun*)sprites->runs.array)[sprites->runs.size - 1].count;
+    }
+
+    glGenVertexArrays(1, &sprites->VAO);
+    glGenBuffers(1, &sprites->VBO);
+    StateBindBuffer(GL_ARRAY_BUFFER, sprites->VBO);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(SpriteInstance), sprites->instances, GL_STATIC_DRAW);
+    initInstancedVAO(sprites->VAO, renderer->quadVBO, sprites->VBO);
+
+    return sprites;
+}
+
+void SetStaticSpriteVisible(StaticSprites* sprites, size_t index, bool visible) {
+    size_t slot = sprites->slots[index];
+    // a hidden sprite keeps its slot but collapses to a zero-sized quad
+    float size[2] = {0.0f, 0.0f};
+    if (visible) {
+        size[0] = sprites->instances[slot].rect[2];
+        size[1] = sprites->instances[slot].rect[3];
+    }
+    StateBindBuffer(GL_ARRAY_BUFFER, sprites->VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, slot * sizeof(SpriteInstance) + offsetof(SpriteInstance, rect) + 2 * sizeof(float), sizeof(size), size);
+}
+
+// Returns the number of draw calls, one per texture run
+unsigned int DrawStaticSprites(SpriteRenderer* renderer, StaticSprites* sprites) {
+    if (sprites->count == 0)
+        return 0;
+
+    UseShader(renderer->shader);
+    StateActiveTexture(GL_TEXTURE0);
+    StateBindVertexArray(sprites->VAO);
+    StateBindBuffer(GL_ARRAY_BUFFER, sprites->VBO);
+    DYNAMIC_ARRAY_FOR_EACH(&sprites->runs, SpriteRun, run) {
+        bindSpriteTexture(renderer, run->texture);
+        setInstancePointers(0, run->first);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, run->count);
+    }
+    return sprites->runs.size;
+}
+
+void DeleteStaticSprites(StaticSprites* sprites) {
+    StateDeleteVertexArray(sprites->VAO);
+    StateDeleteBuffer(sprites->VBO);
+    cleanup(&sprites->runs, NULL);
+    free(sprites->slots);
+    free(sprites->instances);
+    free(sprites);
 }
 
 void DestroySpriteRenderer(SpriteRenderer* renderer) {
-    glDeleteVertexArrays(1, &renderer->quadVAO);
+    StateDeleteVertexArray(renderer->quadVAO);
+    StateDeleteBuffer(renderer->quadVBO);
+    DeleteStreamBuffer(renderer->stream);
+    StateDeleteTexture(renderer->placeholder->ID);
+    free(renderer->placeholder);
     free(renderer);
 }
@@ -0,0 +1,154 @@
+#include "stream_buffer.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gl_state.h"
+#include "util.h"
+
+// Upper bound for a single fence wait, a GPU that takes longer than this is hung anyway
+#define STREAM_FENCE_TIMEOUT 1000000000ull
+
+static DynamicArray streams;  // StreamBuffer* of every live buffer, advanced together each frame
+static bool isInitialized = false;
+static StreamStats current, last;
+
+static void ensureInitialized() {
+    if (isInitialized)
+        return;
+    initialize(&streams, 4, sizeof(StreamBuffer*));
+    isInitialized = true;
+}
+
+bool IsStreamPersistent() {
+    return GLEW_ARB_buffer_storage && glBufferStorage != NULL;
+}
+
+static void allocate(StreamBuffer* stream) {
+    glGenBuffers(1, &stream->buffer);
+    StateBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    if (stream->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        size_t size = stream->segmentSize * STREAM_BUFFER_SEGMENTS;
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        stream->mapping = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, stream->segmentSize, NULL, GL_STREAM_DRAW);
+        stream->mapping = NULL;
+    }
+    stream->segment = 0;
+    stream->offset = 0;
+}
+
+static void release(StreamBuffer* stream) {
+    for (size_t i = 0; i < STREAM_BUFFER_SEGMENTS; ++i) {
+        if (stream->fences[i])
+            glDeleteSync((GLsync)stream->fences[i]);
+        stream->fences[i] = NULL;
+    }
+    // the driver keeps the storage alive until draws already issued from it are done
+    StateDeleteBuffer(stream->buffer);
+    stream->buffer = 0;
+    stream->mapping = NULL;
+}
+
+StreamBuffer* NewStreamBuffer(size_t segmentSize) {
+    ensureInitialized();
+    StreamBuffer* stream = malloc(sizeof(StreamBuffer));
+    *stream = (StreamBuffer){
+        .segmentSize = segmentSize > 0 ? segmentSize : STREAM_BUFFER_ALIGNMENT,
+        .persistent = IsStreamPersistent(),
+    };
+    allocate(stream);
+    pushPtr(&streams, stream);
+    return stream;
+}
+
+// Copies data into the ring and returns its byte offset in stream->buffer
+size_t StreamData(StreamBuffer* stream, const void* data, size_t size) {
+    size_t offset = (stream->offset + STREAM_BUFFER_ALIGNMENT - 1) & ~(size_t)(STREAM_BUFFER_ALIGNMENT - 1);
+    if (offset + size > stream->segmentSize) {
+        if (size > stream->segmentSize || stream->persistent) {
+            // a frame outgrew its segment, start over in a larger buffer
+            size_t segmentSize = stream->segmentSize;
+            while (segmentSize < size || (stream->persistent && segmentSize < offset + size))
+                segmentSize *= 2;
+            release(stream);
+            stream->segmentSize = segmentSize;
+            allocate(stream);
+        } else {
+            // orphan: the driver hands out fresh storage while the GPU finishes with the old one
+            StateBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+            glBufferData(GL_ARRAY_BUFFER, stream->segmentSize, NULL, GL_STREAM_DRAW);
+        }
+        offset = 0;
+    }
+
+    stream->offset = offset + size;
+    current.bytes += size;
+    if (stream->persistent) {
+        offset += stream->segment * stream->segmentSize;
+        memcpy(stream->mapping + offset, data, size);
+    } else {
+        StateBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+        void* target = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (target) {
+            memcpy(target, data, size);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+    }
+    return offset;
+}
+
+// Fences the segment every persistent buffer wrote last frame and moves on to the next one,
+// waiting only when the GPU is still reading it from STREAM_BUFFER_SEGMENTS frames ago
+static void advance(StreamBuffer* stream) {
+    if (!stream->persistent)
+        return;
+    if (stream->offset > 0) {
+        if (stream->fences[stream->segment])
+            glDeleteSync((GLsync)stream->fences[stream->segment]);
+        stream->fences[stream->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    stream->segment = (stream->segment + 1) % STREAM_BUFFER_SEGMENTS;
+    stream->offset = 0;
+
+    GLsync fence = (GLsync)stream->fences[stream->segment];
+    if (!fence)
+        return;
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        double start = glfwGetTime();
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_FENCE_TIMEOUT);
+        ++current.fenceWaits;
+        current.waitMilliseconds += (glfwGetTime() - start) * 1000.0;
+    }
+    glDeleteSync(fence);
+    stream->fences[stream->segment] = NULL;
+}
+
+void BeginStreamFrame() {
+    ensureInitialized();
+    last = current;
+    current = (StreamStats){0};
+    DYNAMIC_ARRAY_FOR_EACH_PTR(&streams, StreamBuffer, stream) {
+        advance(*stream);
+    }
+}
+
+StreamStats GetStreamStats() {
+    return last;
+}
+
+void DeleteStreamBuffer(StreamBuffer* stream) {
+    release(stream);
+    StreamBuffer** entries = (StreamBuffer**)streams.array;
+    for (size_t i = 0; i < streams.size; ++i) {
+        if (entries[i] == stream) {
+            erase(&streams, i, i + 1);
+            break;
+        }
+    }
+    free(stream);
+}
@@ -3,145 +3,223 @@
 #include <GL/glew.h>
 #include <ft2build.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include FT_FREETYPE_H
 
+#include "gl_state.h"
+#include "job_pool.h"
 #include "resource_manager.h"
 #include "shader.h"
+#include "stream_buffer.h"
 #include "util.h"
 
-static unsigned int VAO, VBO;
+#define TEXT_ATLAS_WIDTH 512
+#define TEXT_ATLAS_PADDING 1
 
-TextRenderer* NewTextRenderer(unsigned int width, unsigned int height) {
+static unsigned int VAO;
+static StreamBuffer* stream;
+
+typedef struct {
+    unsigned char* pixels;
+    unsigned int width, rows;
+    unsigned int x, y;
+} GlyphBitmap;
+
+TextRenderer* NewTextRenderer() {
     TextRenderer* tRenderer = malloc(sizeof(TextRenderer));
 
-    initMap(&tRenderer->characters);
+    memset(tRenderer->characters, 0, sizeof(tRenderer->characters));
+    tRenderer->atlasTexture = 0;
+    initialize(&tRenderer->vertices, 256, sizeof(TextVertex));
 
     tRenderer->textShader = LoadShader("shaders/text.vs", "shaders/text.frag", NULL, "text");
-    mfloat_t projection[MAT4_SIZE];
-    mat4_ortho(projection, 0.0f, (float)width, (float)height, 0.0f, -1.0f, 1.0f);
-    setMat4fv(tRenderer->textShader, "projection", projection, true);
-    setInteger(tRenderer->textShader, "text", 0, false);
+    setInteger(tRenderer->textShader, GetUniform(tRenderer->textShader, "text"), 0, true);
 
+    // vertex pointers are set per flush, the data moves around the stream buffer
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+    stream = NewStreamBuffer(256 * sizeof(TextVertex));
+    StateBindVertexArray(VAO);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glEnableVertexAttribArray(1);
+    StateBindVertexArray(0);
 
     return tRenderer;
 }
 
-void LoadText(TextRenderer* tRenderer, char* font, unsigned int fontSize) {
-    clearMap(&tRenderer->characters);
+// Glyphs rasterized into atlas pixels on a worker, uploaded where the context is current
+typedef struct {
+    TextRenderer* tRenderer;
+    char* font;
+    unsigned int fontSize;
+    Character characters[TEXT_GLYPH_COUNT];
+    unsigned char* atlas;
+    unsigned int atlasHeight;
+} FontLoad;
+
+static void rasterizeFont(void* data) {
+    FontLoad* load = (FontLoad*)data;
+    memset(load->characters, 0, sizeof(load->characters));
     FT_Library ft;
     if (FT_Init_FreeType(&ft))
         fprintf(stderr, "Error: Could not init FreeType Library\n");
     FT_Face face;
-    if (FT_New_Face(ft, font, 0, &face))
+    if (FT_New_Face(ft, load->font, 0, &face))
         fprintf(stderr, "Error: Failed to load font\n");
-    FT_Set_Pixel_Sizes(face, 0, fontSize);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    for (GLubyte c = 0; c < 128; c++) {
-        // load character glyph
+    FT_Set_Pixel_Sizes(face, 0, load->fontSize);
+
+    // rasterize every glyph and lay them out in rows of the atlas
+    GlyphBitmap bitmaps[TEXT_GLYPH_COUNT] = {0};
+    unsigned int penX = 0, penY = 0, rowHeight = 0;
+    for (unsigned int c = 0; c < TEXT_GLYPH_COUNT; c++) {
         if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
             fprintf(stderr, "Error: Failed to load Glyph\n");
             continue;
         }
-        // generate texture
-        unsigned int texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer);
-        // set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        // now store character for later use
-        Character* character = malloc(sizeof(Character));
-        *character = (Character){
-            .textureID = texture,
+        FT_Bitmap* bitmap = &face->glyph->bitmap;
+        GlyphBitmap* glyph = &bitmaps[c];
+        glyph->width = bitmap->width;
+        glyph->rows = bitmap->rows;
+        glyph->pixels = malloc((size_t)bitmap->width * bitmap->rows + 1);
+        for (unsigned int row = 0; row < bitmap->rows; ++row)
+            memcpy(glyph->pixels + row * bitmap->width, bitmap->buffer + row * bitmap->pitch, bitmap->width);
+
+        if (penX + glyph->width + TEXT_ATLAS_PADDING > TEXT_ATLAS_WIDTH) {
+            penX = 0;
+            penY += rowHeight + TEXT_ATLAS_PADDING;
+            rowHeight = 0;
+        }
+        glyph->x = penX;
+        glyph->y = penY;
+        penX += glyph->width + TEXT_ATLAS_PADDING;
+        if (glyph->rows > rowHeight)
+            rowHeight = glyph->rows;
+
+        load->characters[c] = (Character){
             .size = {face->glyph->bitmap.width, face->glyph->bitmap.rows},
             .bearing = {face->glyph->bitmap_left, face->glyph->bitmap_top},
             .advance = face->glyph->advance.x,
         };
-
-        char* keyString = malloc(2);
-        keyString[0] = (char)c;
-        keyString[1] = '\0';
-
-        Key key = {KEY_TYPE_STRING, .strKey = keyString};
-        insertIntoMap(&tRenderer->characters, key, character);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
+    unsigned int atlasHeight = penY + rowHeight;
+    if (atlasHeight == 0)
+        atlasHeight = 1;
+
+    unsigned char* atlas = calloc((size_t)TEXT_ATLAS_WIDTH * atlasHeight, 1);
+    for (unsigned int c = 0; c < TEXT_GLYPH_COUNT; c++) {
+        GlyphBitmap* glyph = &bitmaps[c];
+        for (unsigned int row = 0; row < glyph->rows; ++row)
+            memcpy(atlas + (size_t)(glyph->y + row) * TEXT_ATLAS_WIDTH + glyph->x, glyph->pixels + row * glyph->width, glyph->width);
+        free(glyph->pixels);
+
+        Character* ch = &load->characters[c];
+        ch->uv[0] = glyph->x / (float)TEXT_ATLAS_WIDTH;
+        ch->uv[1] = glyph->y / (float)atlasHeight;
+        ch->uv[2] = (glyph->x + glyph->width) / (float)TEXT_ATLAS_WIDTH;
+        ch->uv[3] = (glyph->y + glyph->rows) / (float)atlasHeight;
+    }
+    load->atlas = atlas;
+    load->atlasHeight = atlasHeight;
+
     FT_Done_Face(face);
     FT_Done_FreeType(ft);
 }
 
-void RenderText(TextRenderer* tRenderer, char* text, float x, float y, float scale, mfloat_t* color) {
-    UseShader(tRenderer->textShader);
-    setVec3fv(tRenderer->textShader, "textColor", color ? color : (mfloat_t[VEC3_SIZE]){1.0f, 1.0f, 1.0f}, false);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(VAO);
-
-    char hString[2];
-    hString[0] = 'H';
-    hString[1] = '\0';
-
-    Key hKey = {KEY_TYPE_STRING, .strKey = hString};
-    void* hRes = getFromMap(&tRenderer->characters, hKey);
-    Character hCh = *(Character*)hRes;
-
-    const char* c;
-    for (c = text; *c != '\0'; c++) {
-        char keyString[2];
-        keyString[0] = *c;
-        keyString[1] = '\0';
-
-        Key key = {KEY_TYPE_STRING, .strKey = keyString};
-        void* result = getFromMap(&tRenderer->characters, key);
-        Character ch = *(Character*)result;
-
-        float xpos = x + ch.bearing[0] * scale;
-        float ypos = y + (hCh.bearing[1] - ch.bearing[1]) * scale;
-
-        float w = ch.size[0] * scale;
-        float h = ch.size[1] * scale;
-
-        // update VBO for each character
-        float vertices[6][4] = {
-            {xpos, ypos + h, 0.0f, 1.0f},
-            {xpos + w, ypos, 1.0f, 0.0f},
-            {xpos, ypos, 0.0f, 0.0f},
-
-            {xpos, ypos + h, 0.0f, 1.0f},
-            {xpos + w, ypos + h, 1.0f, 1.0f},
-            {xpos + w, ypos, 1.0f, 0.0f},
-        };
+static void uploadFont(void* data) {
+    FontLoad* load = (FontLoad*)data;
+    TextRenderer* tRenderer = load->tRenderer;
+    memcpy(tRenderer->characters, load->characters, sizeof(tRenderer->characters));
+    if (tRenderer->atlasTexture) {
+        StateDeleteTexture(tRenderer->atlasTexture);
+        tRenderer->atlasTexture = 0;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(1, &tRenderer->atlasTexture);
+    StateBindTexture(GL_TEXTURE_2D, tRenderer->atlasTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, TEXT_ATLAS_WIDTH, load->atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, load->atlas);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    free(load->atlas);
+    free(load);
+}
+
+static FontLoad* newFontLoad(TextRenderer* tRenderer, char* font, unsigned int fontSize) {
+    FontLoad* load = malloc(sizeof(FontLoad));
+    load->tRenderer = tRenderer;
+    load->font = font;
+    load->fontSize = fontSize;
+    load->atlas = NULL;
+    return load;
+}
 
-        glBindTexture(GL_TEXTURE_2D, ch.textureID);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+void LoadText(TextRenderer* tRenderer, char* font, unsigned int fontSize) {
+    FontLoad* load = newFontLoad(tRenderer, font, fontSize);
+    rasterizeFont(load);
+    uploadFont(load);
+}
+
+// Rasterizes on a worker and uploads the glyph atlas in FinishJobs, the font name must stay valid until then
+void LoadTextAsync(TextRenderer* tRenderer, char* font, unsigned int fontSize) {
+    SubmitJob(rasterizeFont, uploadFont, newFontLoad(tRenderer, font, fontSize));
+}
+
+void QueueText(TextRenderer* tRenderer, char* text, float x, float y, float scale, mfloat_t* color) {
+    mfloat_t* textColor = color ? color : (mfloat_t[VEC3_SIZE]){1.0f, 1.0f, 1.0f};
+    const Character* hCh = &tRenderer->characters['H'];
+
+    for (const char* c = text; *c != '\0'; c++) {
+        unsigned char index = (unsigned char)*c;
+        if (index >= TEXT_GLYPH_COUNT)
+            continue;
+        const Character* ch = &tRenderer->characters[index];
+
+        float xpos = x + ch->bearing[0] * scale;
+        float ypos = y + (hCh->bearing[1] - ch->bearing[1]) * scale;
+
+        float w = ch->size[0] * scale;
+        float h = ch->size[1] * scale;
+
+        float u0 = ch->uv[0], v0 = ch->uv[1], u1 = ch->uv[2], v1 = ch->uv[3];
+        TextVertex quad[6] = {
+            {{xpos, ypos + h}, {u0, v1}, {textColor[0], textColor[1], textColor[2]}},
+            {{xpos + w, ypos}, {u1, v0}, {textColor[0], textColor[1], textColor[2]}},
+            {{xpos, ypos}, {u0, v0}, {textColor[0], textColor[1], textColor[2]}},
 
-        x += (ch.advance >> 6) * scale;
+            {{xpos, ypos + h}, {u0, v1}, {textColor[0], textColor[1], textColor[2]}},
+            {{xpos + w, ypos + h}, {u1, v1}, {textColor[0], textColor[1], textColor[2]}},
+            {{xpos + w, ypos}, {u1, v0}, {textColor[0], textColor[1], textColor[2]}},
+        };
+        for (size_t i = 0; i < 6; ++i)
+            push(&tRenderer->vertices, &quad[i]);
+
+        x += (ch->advance >> 6) * scale;
     }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void FlushText(TextRenderer* tRenderer) {
+    size_t count = tRenderer->vertices.size;
+    if (count == 0)
+        return;
+
+    size_t offset = StreamData(stream, tRenderer->vertices.array, count * sizeof(TextVertex));
+
+    UseShader(tRenderer->textShader);
+    StateActiveTexture(GL_TEXTURE0);
+    StateBindTexture(GL_TEXTURE_2D, tRenderer->atlasTexture);
+    StateBindVertexArray(VAO);
+    StateBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)(offset + offsetof(TextVertex, position)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)(offset + offsetof(TextVertex, color)));
+    glDrawArrays(GL_TRIANGLES, 0, count);
+
+    clearArray(&tRenderer->vertices, NULL);
+}
+
+void RenderText(TextRenderer* tRenderer, char* text, float x, float y, float scale, mfloat_t* color) {
+    QueueText(tRenderer, text, x, y, scale, color);
+    FlushText(tRenderer);
 }
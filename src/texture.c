@@ -2,6 +2,20 @@
 
 #include <GL/glew.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "gl_state.h"
+#include "util.h"
+
+// Upload still in flight, the pixel buffer lives until the fence behind the transfer signals
+typedef struct {
+    Texture2D* texture;
+    unsigned int PBO;
+    GLsync fence;
+} PendingUpload;
+
+static DynamicArray pending;
+static bool isInitialized = false;
 
 Texture2D* NewTexture() {
     Texture2D* texture = malloc(sizeof(Texture2D));
@@ -13,26 +27,130 @@ Texture2D* NewTexture() {
     texture->wrapT = GL_REPEAT;
     texture->filterMin = GL_LINEAR;
     texture->filterMax = GL_LINEAR;
+    texture->uv[0] = 0.0f;
+    texture->uv[1] = 0.0f;
+    texture->uv[2] = 1.0f;
+    texture->uv[3] = 1.0f;
+    texture->isRegion = false;
+    texture->page = NULL;
+    texture->status = TEXTURE_READY;
 
     glGenTextures(1, &texture->ID);
     return texture;
 }
 
+static void setParameters(Texture2D* texture) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture->wrapS);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture->wrapT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->filterMin);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texture->filterMax);
+}
+
+static unsigned int bytesPerPixel(unsigned int format) {
+    switch (format) {
+        case GL_RED:
+            return 1;
+        case GL_RG:
+            return 2;
+        case GL_RGB:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
 void GenerateTexture(Texture2D* texture, unsigned int width, unsigned int height, unsigned char* data) {
     texture->width = width;
     texture->height = height;
+    texture->status = TEXTURE_READY;
 
-    glBindTexture(GL_TEXTURE_2D, texture->ID);
+    StateBindTexture(GL_TEXTURE_2D, texture->ID);
     glTexImage2D(GL_TEXTURE_2D, 0, texture->internalFormat, width, height, 0, texture->imageFormat, GL_UNSIGNED_BYTE, data);
+    setParameters(texture);
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture->wrapS);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture->wrapT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->filterMin);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texture->filterMax);
+// Copies the pixels into a pixel unpack buffer and lets the transfer into the texture run on the
+// GPU's time. The texture stays TEXTURE_PENDING until PollTextureUploads sees its fence signal,
+// the caller may free data as soon as this returns.
+void GenerateTextureAsync(Texture2D* texture, unsigned int width, unsigned int height, const unsigned char* data) {
+    if (!isInitialized) {
+        initialize(&pending, 8, sizeof(PendingUpload));
+        isInitialized = true;
+    }
+    texture->width = width;
+    texture->height = height;
+
+    size_t size = (size_t)width * height * bytesPerPixel(texture->imageFormat);
+    PendingUpload upload = {.texture = texture};
+    glGenBuffers(1, &upload.PBO);
+    StateBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.PBO);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!staging) {
+        // no staging memory, fall back to the synchronous path
+        StateBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        StateDeleteBuffer(upload.PBO);
+        GenerateTexture(texture, width, height, (unsigned char*)data);
+        return;
+    }
+    memcpy(staging, data, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // with a pixel buffer bound the data argument is an offset into it
+    StateBindTexture(GL_TEXTURE_2D, texture->ID);
+    glTexImage2D(GL_TEXTURE_2D, 0, texture->internalFormat, width, height, 0, texture->imageFormat, GL_UNSIGNED_BYTE, (void*)0);
+    setParameters(texture);
+    StateBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // make sure the fence reaches the GPU, polling alone never flushes
+    glFlush();
+    texture->status = TEXTURE_PENDING;
+    push(&pending, &upload);
+}
+
+bool IsTextureReady(const Texture2D* texture) {
+    const Texture2D* owner = texture->page ? texture->page : texture;
+    return owner->status == TEXTURE_READY;
+}
+
+static void completeUpload(PendingUpload* upload) {
+    glDeleteSync(upload->fence);
+    StateDeleteBuffer(upload->PBO);
+    upload->texture->status = TEXTURE_READY;
+}
+
+// Marks every texture whose transfer finished as ready without ever waiting on the GPU
+void PollTextureUploads() {
+    if (!isInitialized || pending.size == 0)
+        return;
+    PendingUpload* uploads = (PendingUpload*)pending.array;
+    size_t kept = 0;
+    for (size_t i = 0; i < pending.size; ++i) {
+        GLenum result = glClientWaitSync(uploads[i].fence, 0, 0);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            completeUpload(&uploads[i]);
+        else
+            uploads[kept++] = uploads[i];
+    }
+    pending.size = kept;
+}
+
+bool HasPendingTextureUploads() {
+    return isInitialized && pending.size > 0;
+}
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+// Blocks until every upload in flight is done, for teardown and for callers that need the pixels now
+void FinishTextureUploads() {
+    if (!isInitialized)
+        return;
+    DYNAMIC_ARRAY_FOR_EACH(&pending, PendingUpload, upload) {
+        glClientWaitSync(upload->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        completeUpload(upload);
+    }
+    clearArray(&pending, NULL);
 }
 
 void BindTexture(Texture2D* texture) {
-    glBindTexture(GL_TEXTURE_2D, texture->ID);
+    StateBindTexture(GL_TEXTURE_2D, texture->ID);
 }
@@ -0,0 +1,203 @@
+#include "texture_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "stb_image.h"
+
+static const char CACHE_MAGIC[4] = {'B', 'T', 'X', 'C'};
+
+uint64_t HashBytes(const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static unsigned char* readBinaryFile(const char* file, size_t* size) {
+    FILE* in = fopen(file, "rb");
+    if (!in)
+        return NULL;
+    fseek(in, 0, SEEK_END);
+    long length = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    unsigned char* data = length > 0 ? malloc(length) : NULL;
+    if (data && fread(data, 1, length, in) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(in);
+    *size = data ? (size_t)length : 0;
+    return data;
+}
+
+static char* cachePath(const char* file) {
+    size_t length = strlen(file);
+    char* path = malloc(length + sizeof(TEXTURE_CACHE_EXTENSION));
+    memcpy(path, file, length);
+    memcpy(path + length, TEXTURE_CACHE_EXTENSION, sizeof(TEXTURE_CACHE_EXTENSION));
+    return path;
+}
+
+static bool mapFile(const char* path, CachedImage* image) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    HANDLE fileMapping = NULL;
+    void* view = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (fileMapping)
+        view = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        if (fileMapping)
+            CloseHandle(fileMapping);
+        CloseHandle(file);
+        return false;
+    }
+    image->file = file;
+    image->fileMapping = fileMapping;
+    image->mapping = view;
+    image->mappingSize = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat status;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+        view = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive on its own
+    close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    image->mapping = view;
+    image->mappingSize = (size_t)status.st_size;
+#endif
+    return true;
+}
+
+static void unmapFile(CachedImage* image) {
+    if (!image->mapping)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(image->mapping);
+    CloseHandle(image->fileMapping);
+    CloseHandle(image->file);
+    image->file = image->fileMapping = NULL;
+#else
+    munmap(image->mapping, image->mappingSize);
+#endif
+    image->mapping = NULL;
+    image->mappingSize = 0;
+}
+
+// Maps the cache file and checks it was made from the same source bytes in the requested layout
+static bool openCache(const char* path, uint64_t sourceHash, int channels, CachedImage* image) {
+    if (!mapFile(path, image))
+        return false;
+    const TextureCacheHeader* header = (const TextureCacheHeader*)image->mapping;
+    bool valid = image->mappingSize >= sizeof(TextureCacheHeader) &&
+                 memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+                 header->version == TEXTURE_CACHE_VERSION &&
+                 header->sourceHash == sourceHash &&
+                 (channels == 0 || header->channels == (uint32_t)channels) &&
+                 image->mappingSize == sizeof(TextureCacheHeader) + (size_t)header->width * header->height * header->channels;
+    if (!valid) {
+        unmapFile(image);
+        return false;
+    }
+    image->pixels = (const unsigned char*)image->mapping + sizeof(TextureCacheHeader);
+    image->width = header->width;
+    image->height = header->height;
+    image->channels = header->channels;
+    image->cached = true;
+    return true;
+}
+
+// Written under a temporary name and renamed, so a crash never leaves a truncated cache behind
+static void writeCache(const char* path, uint64_t sourceHash, const CachedImage* image) {
+    TextureCacheHeader header = {
+        .version = TEXTURE_CACHE_VERSION,
+        .width = image->width,
+        .height = image->height,
+        .channels = image->channels,
+        .reserved = 0,
+        .sourceHash = sourceHash,
+    };
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+
+    size_t length = strlen(path);
+    char* temporary = malloc(length + 5);
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", 5);
+
+    FILE* out = fopen(temporary, "wb");
+    if (!out) {
+        fprintf(stderr, "Error: Could not write texture cache %s\n", path);
+        free(temporary);
+        return;
+    }
+    size_t size = (size_t)image->width * image->height * image->channels;
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(image->pixels, 1, size, out) == size;
+    written = fclose(out) == 0 && written;
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (!written || rename(temporary, path) != 0) {
+        fprintf(stderr, "Error: Could not write texture cache %s\n", path);
+        remove(temporary);
+    }
+    free(temporary);
+}
+
+bool LoadCachedImage(const char* file, int channels, CachedImage* image) {
+    memset(image, 0, sizeof(CachedImage));
+    size_t sourceSize = 0;
+    unsigned char* source = readBinaryFile(file, &sourceSize);
+    if (!source)
+        return false;
+
+    uint64_t sourceHash = HashBytes(source, sourceSize);
+    char* path = cachePath(file);
+    if (openCache(path, sourceHash, channels, image)) {
+        free(path);
+        free(source);
+        return true;
+    }
+
+    int sourceChannels;
+    image->decoded = stbi_load_from_memory(source, (int)sourceSize, &image->width, &image->height, &sourceChannels, channels);
+    free(source);
+    if (!image->decoded) {
+        free(path);
+        return false;
+    }
+    image->pixels = image->decoded;
+    image->channels = channels != 0 ? channels : sourceChannels;
+    writeCache(path, sourceHash, image);
+    free(path);
+    return true;
+}
+
+void ReleaseCachedImage(CachedImage* image) {
+    if (image->decoded)
+        stbi_image_free(image->decoded);
+    unmapFile(image);
+    image->decoded = NULL;
+    image->pixels = NULL;
+}